@@ -38,5 +38,11 @@ CONFIG(release, debug|release) {
   }
 }
 
-unix:LIBS += -lboost_program_options
+unix:LIBS += -lboost_program_options -lboost_thread -lboost_system
 unix:QMAKE_CXXFLAGS += -std=c++0x
+
+# Decode JPEG scans directly into luma with libjpeg: qmake CONFIG+=libjpeg
+libjpeg {
+  DEFINES          += BRT_USE_LIBJPEG
+  LIBS             += -ljpeg
+}
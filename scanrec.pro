@@ -39,8 +39,14 @@ CONFIG(release, debug|release) {
   }
 }
 
-unix:LIBS += -lboost_program_options
+unix:LIBS += -lboost_program_options -lboost_thread -lboost_system
 unix:QMAKE_CXXFLAGS += -std=c++0x
 
+# Decode JPEG scans directly into luma with libjpeg: qmake CONFIG+=libjpeg
+libjpeg {
+  DEFINES          += BRT_USE_LIBJPEG
+  LIBS             += -ljpeg
+}
+
 #QMAKE_CXXFLAGS_RELEASE += /Zi
 #QMAKE_LFLAGS_RELEASE += /DEBUG
\ No newline at end of file
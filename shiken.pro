@@ -180,8 +180,15 @@ CONFIG(release, debug|release) {
 #win32:RC_FILE    = src/res/shiken.rc
 win32:LIBS += Crypt32.lib
 
+unix:LIBS += -lboost_thread -lboost_system
 unix:QMAKE_CXXFLAGS += -std=c++0x
 
+# Decode JPEG scans directly into luma with libjpeg: qmake CONFIG+=libjpeg
+libjpeg {
+  DEFINES          += BRT_USE_LIBJPEG
+  LIBS             += -ljpeg
+}
+
 # Set up xsde compiler
 for(XSD_MAP, XSD_MAPS):XSD_MAPFLAGS += --type-map $${XSD_MAP}
 xsde.name = Generating code from ${QMAKE_FILE_IN}
@@ -2,11 +2,22 @@
 #define COMMON_H
 
 #include "config.h"
+#include <cassert>
 #include <fstream>
-#include <algorithm> /* for std::max() */
+#include <map>
+#include <algorithm> /* for std::min() and std::max() */
+#include <cmath>
+#include <complex>
+#include <limits>
 #include <exception> /* for std::logic_error */
 #include <vector>
 #include <boost/lexical_cast.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/program_options.hpp>
+#include <QFile>
 #include <arx/ext/Vigra.h>
 #include <arx/ext/Qt.h>
 #include <arx/ext/VigraQt.h>
@@ -16,45 +27,71 @@
 #include "acv/Lma.h"
 #include "acv/CollageLmaModeller.h"
 #include "acv/CollageRansacModeller.h"
+#include "barcode/ItfDetection.h"
+#include "barcode/ItfLocator.h"
 #include "barcode/ItfRecognizer.h"
 #include "ImageUtils.h"
+#include "EncodedImage.h"
+#include "MappedImage.h"
+#include "QImageViews.h"
+#include "KeypointTemplate.h"
+#include "KeypointIndex.h"
+#include "KeypointMatcher.h"
+#include "ScanTracker.h"
 
 typedef acv::CollageRansacModeller<acv::Match> RansacModeller;
 typedef acv::CollageLmaModeller<acv::Match> LmaModeller;
 typedef RansacModeller::model_type RansacModel;
 
 /**
- * Extracts keypoints from a given image.
+ * Statistics of a single keypoint matching attempt, see
+ * progressiveMatchModel().
+ */
+struct MatchAttempt {
+  MatchAttempt(): keyImageSize(0, 0), ransacIterations(0), keypoints(0), inliers(0), error(0.0), accepted(false) {}
+
+  vigra::Size2D keyImageSize;   /**< Maximal size of an image to extract keypoints from. */
+  int ransacIterations;         /**< Number of RANSAC iterations. */
+  int keypoints;                /**< Number of keypoints extracted from the image. */
+  int inliers;                  /**< Number of inliers of the estimated transformation. */
+  double error;                 /**< Root mean square reprojection error of the inliers, in template pixels. */
+  bool accepted;                /**< Whether the match was good enough to stop escalating. */
+};
+
+/**
+ * Extracts keypoints from a given image. Image is given as a vigra source
+ * range, so that views of decoded images can be used without copying them,
+ * e.g. rgb32View() with QRgbGrayAccessor. Only the image that keypoints are
+ * extracted from is allocated.
  * 
- * @param scrImage                     Image to extract keypoints from.
+ * @param src                          Image to extract keypoints from.
  * @param maxKeyImageSize              Maximal size of an image to extract
  *                                     keypoints from. Source image will be 
  *                                     resized before keypoint extraction to
  *                                     fit into this size.
  * @param[out] extract                 Keypoint extract.
+ * @param imageScale                   Scale of the original image relative
+ *                                     to the source image, if the source
+ *                                     image is already reduced. Keypoints
+ *                                     are returned in coordinates of the
+ *                                     original image.
  */
-template<class PixelType, class VigraAlloc, class Allocator>
-void extractKeypoints(const vigra::BasicImage<PixelType, VigraAlloc>& srcImage, const vigra::Size2D& maxKeyImageSize, acv::Extract<Allocator>& extract) {
-  typedef vigra::BasicImage<float, typename VigraAlloc::template rebind<float>::other> Image;
-
+template<class SrcIterator, class SrcAccessor, class Allocator>
+void extractKeypoints(vigra::triple<SrcIterator, SrcIterator, SrcAccessor> src, const vigra::Size2D& maxKeyImageSize, acv::Extract<Allocator>& extract, float imageScale = 1.0f) {
   /* Resize if needed. */
-  boost::scoped_ptr<Image> imageHolder;
-  const Image* pKeyImage = NULL;
-  float scale = std::max(1.0f, std::max(static_cast<float>(srcImage.width()) / maxKeyImageSize.width(), static_cast<float>(srcImage.height()) / maxKeyImageSize.height()));
+  vigra::Size2D size(src.second - src.first);
+  float scale = std::max(1.0f, std::max(static_cast<float>(size.width()) / maxKeyImageSize.width(), static_cast<float>(size.height()) / maxKeyImageSize.height()));
+  vigra::FImage keyImage;
   if(scale > 1) {
-    using std::swap;
-
-    imageHolder.reset(new Image(srcImage.width() / scale, srcImage.height() / scale));
-    resizeImageLinearInterpolation(srcImageRange(srcImage, vigra::ConvertingAccessor<PixelType, float>()), destImageRange(*imageHolder));
-    pKeyImage = imageHolder.get();
+    keyImage.resize(static_cast<int>(size.width() / scale), static_cast<int>(size.height() / scale));
+    resizeImageLinearInterpolation(src, destImageRange(keyImage));
   } else {
-    imageHolder.reset(new Image());
-    pKeyImage = &convert_nocopy(srcImage, *imageHolder);
+    keyImage.resize(size);
+    copyImage(src, destImage(keyImage));
   }
-  const Image& keyImage = *pKeyImage;
 
   /* Extract keypoints from input image. */
-  acv::Extractor()(keyImage, INITIAL_SMOOTHNESS / scale, scale, extract);
+  acv::Extractor()(keyImage, INITIAL_SMOOTHNESS / (scale * imageScale), scale * imageScale, extract);
 
   /* Check number of extracted keypoints. */
   if(extract.keypoints().size() < MIN_KEYPOINTS_PER_IMAGE) {
@@ -66,8 +103,15 @@ void extractKeypoints(const vigra::BasicImage<PixelType, VigraAlloc>& srcImage,
 }
 
 /**
- * Matches the given image against the given keypoint extract and aligns it
- * correspondingly.
+ * Extracts keypoints from a given image, see above.
+ */
+template<class PixelType, class VigraAlloc, class Allocator>
+void extractKeypoints(const vigra::BasicImage<PixelType, VigraAlloc>& srcImage, const vigra::Size2D& maxKeyImageSize, acv::Extract<Allocator>& extract, float imageScale = 1.0f) {
+  extractKeypoints(srcImageRange(srcImage, vigra::ConvertingAccessor<PixelType, float>()), maxKeyImageSize, extract, imageScale);
+}
+
+/**
+ * Matches the given image against the given keypoint extract.
  *
  * @param scrImage                     Image to match.
  * @param maxKeyImageSize              Maximal size of an image to extract
@@ -76,21 +120,25 @@ void extractKeypoints(const vigra::BasicImage<PixelType, VigraAlloc>& srcImage,
  *                                     fit into this size.
  * @param extract                      Keypoint extract to match the source
  *                                     image to.
- * @param[out] outImage                Aligned image.
  * @param maxRansacError               Maximal RANSAC error used for keypoint
  *                                     match filtering.
  * @param useLma                       Perform transformation optimization with 
  *                                     Levenberg-Marquardt after initial
  *                                     estimation via RANSAC?
+ * @param imageScale                   Scale of the original image relative
+ *                                     to the source image, see
+ *                                     extractKeypoints().
+ * @returns                            Transformation from original image
+ *                                     coordinates to extract coordinates.
  */
 template<class PixelType, class VigraAlloc, class Allocator>
-RansacModel match(
+RansacModel matchModel(
   const vigra::BasicImage<PixelType, VigraAlloc>& srcImage, 
   const vigra::Size2D& maxKeyImageSize,
   const acv::Extract<Allocator>& extract, 
-  vigra::BasicImage<PixelType, VigraAlloc>& outImage, 
   double maxRansacError, 
-  bool useLma
+  bool useLma,
+  float imageScale = 1.0f
 ) {
   /* Check number of input keypoints. */
   if(extract.keypoints().size() < MIN_KEYPOINTS_PER_IMAGE) {
@@ -102,7 +150,7 @@ RansacModel match(
 
   /* Extract keypoints from input image. */
   acv::Extract<> newExtract;
-  extractKeypoints(srcImage, maxKeyImageSize, newExtract);
+  extractKeypoints(srcImage, maxKeyImageSize, newExtract, imageScale);
 
   /* Match. */
   std::vector<acv::Match> matches;
@@ -114,6 +162,390 @@ RansacModel match(
   RansacModel model = matcher.bestModel();
   if(useLma)
     model = acv::Lma<LmaModeller>(LmaModeller(matches))(model);
+  return model;
+}
+
+/**
+ * @param a                            Linear part of a similarity
+ *                                     transformation z -> a * z + b.
+ * @param b                            Translation part of a similarity
+ *                                     transformation.
+ * @returns                            The same transformation as a model.
+ */
+inline RansacModel similarityModel(std::complex<double> a, std::complex<double> b) {
+  Eigen::Matrix3d matrix;
+  matrix << 
+    a.real(), -a.imag(), b.real(),
+    a.imag(),  a.real(), b.imag(),
+    0.0,       0.0,      1.0;
+  return RansacModel(matrix);
+}
+
+/**
+ * Matches the given image against an indexed keypoint template. Template
+ * descriptors are searched with the index, and the similarity
+ * transformation is estimated with KeypointMatcher instead of acv::Matcher.
+ *
+ * @param src                          Image to match, see
+ *                                     extractKeypoints().
+ * @param maxKeyImageSize              Maximal size of an image to extract
+ *                                     keypoints from, see extractKeypoints().
+ * @param index                        Descriptor index of the keypoint
+ *                                     template to match the source image to.
+ * @param maxRansacError               Maximal RANSAC error used for keypoint
+ *                                     match filtering.
+ * @param useLma                       Refine the transformation with least
+ *                                     squares on all inliers after initial
+ *                                     estimation via RANSAC? For a
+ *                                     similarity the least squares solution
+ *                                     is exact, so no Levenberg-Marquardt
+ *                                     iterations are needed.
+ * @param imageScale                   Scale of the original image relative
+ *                                     to the source image, see
+ *                                     extractKeypoints().
+ * @param ransacIterations             Number of RANSAC iterations.
+ * @param[out] attempt                 If not NULL, receives the statistics
+ *                                     of the match, also when matching
+ *                                     fails.
+ * @returns                            Transformation from original image
+ *                                     coordinates to template coordinates.
+ */
+template<class SrcIterator, class SrcAccessor>
+RansacModel matchModel(
+  vigra::triple<SrcIterator, SrcIterator, SrcAccessor> src, 
+  const vigra::Size2D& maxKeyImageSize,
+  const KeypointIndex& index, 
+  double maxRansacError, 
+  bool useLma,
+  float imageScale = 1.0f,
+  int ransacIterations = SIMILARITY_RANSAC_ITERATIONS,
+  MatchAttempt* attempt = NULL
+) {
+  if(attempt != NULL) {
+    *attempt = MatchAttempt();
+    attempt->keyImageSize = maxKeyImageSize;
+    attempt->ransacIterations = ransacIterations;
+  }
+
+  /* Check number of input keypoints. */
+  if(index.keys().size() < MIN_KEYPOINTS_PER_IMAGE) {
+    throw std::logic_error(
+      "Too little keypoints were provided: " + boost::lexical_cast<std::string>(index.keys().size()) + 
+      " while at least " + boost::lexical_cast<std::string>(MIN_KEYPOINTS_PER_IMAGE) + " are required."
+    );
+  }
+
+  /* Extract keypoints from input image. */
+  acv::Extract<> newExtract;
+  extractKeypoints(src, maxKeyImageSize, newExtract, imageScale);
+  KeypointTemplate newKeys(newExtract.width(), newExtract.height(), newExtract.keypoints());
+
+  /* Match. */
+  KeypointMatcher matcher(index, maxRansacError, ransacIterations);
+  bool matched = matcher(newKeys, useLma);
+  if(attempt != NULL) {
+    attempt->keypoints = newKeys.size();
+    attempt->inliers = matcher.inliers();
+    attempt->error = matcher.error();
+  }
+  if(!matched)
+    throw std::logic_error("Image did not match to the keypoints provided.");
+
+  return similarityModel(matcher.a(), matcher.b());
+}
+
+/**
+ * Matches the given image against an indexed keypoint template, see above.
+ */
+template<class PixelType, class VigraAlloc>
+RansacModel matchModel(
+  const vigra::BasicImage<PixelType, VigraAlloc>& srcImage, 
+  const vigra::Size2D& maxKeyImageSize,
+  const KeypointIndex& index, 
+  double maxRansacError, 
+  bool useLma,
+  float imageScale = 1.0f,
+  int ransacIterations = SIMILARITY_RANSAC_ITERATIONS,
+  MatchAttempt* attempt = NULL
+) {
+  return matchModel(srcImageRange(srcImage, vigra::ConvertingAccessor<PixelType, float>()), maxKeyImageSize, index, maxRansacError, useLma, imageScale, ransacIterations, attempt);
+}
+
+/**
+ * Matches the given image against an indexed keypoint template, starting
+ * with a cheap match on a small image and escalating to larger images and
+ * more RANSAC iterations only if the match is poor. Level i of
+ * PROGRESSIVE_MATCH_LEVELS extracts keypoints from an image reduced to fit
+ * into maxKeyImageSize / 2^(PROGRESSIVE_MATCH_LEVELS - 1 - i). A level is
+ * accepted if it has at least PROGRESSIVE_MATCH_MIN_INLIERS inliers with
+ * error below PROGRESSIVE_MATCH_MAX_ERROR of the maximal RANSAC error. The
+ * last level that matched is used if none is accepted.
+ *
+ * @param src                          Image to match, see
+ *                                     extractKeypoints().
+ * @param maxKeyImageSize              Maximal size of an image to extract
+ *                                     keypoints from, used by the last
+ *                                     level.
+ * @param index                        Descriptor index of the keypoint
+ *                                     template to match the source image to.
+ * @param maxRansacError               Maximal RANSAC error used for keypoint
+ *                                     match filtering.
+ * @param useLma                       Refine the transformation with least
+ *                                     squares, see matchModel().
+ * @param imageScale                   Scale of the original image relative
+ *                                     to the source image, see
+ *                                     extractKeypoints().
+ * @param[out] path                    If not NULL, receives the levels
+ *                                     tried, in order.
+ * @returns                            Transformation from original image
+ *                                     coordinates to template coordinates.
+ */
+template<class SrcIterator, class SrcAccessor>
+RansacModel progressiveMatchModel(
+  vigra::triple<SrcIterator, SrcIterator, SrcAccessor> src, 
+  const vigra::Size2D& maxKeyImageSize,
+  const KeypointIndex& index, 
+  double maxRansacError, 
+  bool useLma,
+  float imageScale = 1.0f,
+  std::vector<MatchAttempt>* path = NULL
+) {
+  double maxError = PROGRESSIVE_MATCH_MAX_ERROR * maxRansacError * std::max(index.keys().width(), index.keys().height());
+
+  RansacModel result;
+  bool matched = false;
+  std::string lastError;
+  for(int level = PROGRESSIVE_MATCH_LEVELS - 1; level >= 0; level--) {
+    vigra::Size2D keyImageSize(std::max(1, maxKeyImageSize.width() >> level), std::max(1, maxKeyImageSize.height() >> level));
+    int ransacIterations = SIMILARITY_RANSAC_ITERATIONS << (PROGRESSIVE_MATCH_LEVELS - 1 - level);
+
+    MatchAttempt attempt;
+    try {
+      result = matchModel(src, keyImageSize, index, maxRansacError, useLma, imageScale, ransacIterations, &attempt);
+      matched = true;
+      attempt.accepted = attempt.inliers >= PROGRESSIVE_MATCH_MIN_INLIERS && attempt.error <= maxError;
+    } catch (std::exception& e) {
+      lastError = e.what();
+    }
+    if(path != NULL)
+      path->push_back(attempt);
+
+    if(attempt.accepted)
+      break;
+  }
+
+  if(!matched)
+    throw std::logic_error(lastError);
+  return result;
+}
+
+/**
+ * Matches the given image against an indexed keypoint template
+ * progressively, see above.
+ */
+template<class PixelType, class VigraAlloc>
+RansacModel progressiveMatchModel(
+  const vigra::BasicImage<PixelType, VigraAlloc>& srcImage, 
+  const vigra::Size2D& maxKeyImageSize,
+  const KeypointIndex& index, 
+  double maxRansacError, 
+  bool useLma,
+  float imageScale = 1.0f,
+  std::vector<MatchAttempt>* path = NULL
+) {
+  return progressiveMatchModel(srcImageRange(srcImage, vigra::ConvertingAccessor<PixelType, float>()), maxKeyImageSize, index, maxRansacError, useLma, imageScale, path);
+}
+
+namespace detail {
+  /**
+   * @returns                          Maximal size of a region of an image
+   *                                   for keypoint extraction, so that the
+   *                                   region is reduced by the same factor
+   *                                   as the whole image would be.
+   */
+  inline vigra::Size2D maxRegionKeyImageSize(const vigra::Size2D& imageSize, const vigra::Rect2D& rect, const vigra::Size2D& maxKeyImageSize) {
+    float scale = std::max(1.0f, std::max(static_cast<float>(imageSize.width()) / maxKeyImageSize.width(), static_cast<float>(imageSize.height()) / maxKeyImageSize.height()));
+    return vigra::Size2D(
+      static_cast<int>(std::ceil(rect.width() / scale)),
+      static_cast<int>(std::ceil(rect.height() / scale))
+    );
+  }
+
+  /**
+   * @returns                          Given transformation of region
+   *                                   coordinates, shifted to transform
+   *                                   image coordinates.
+   */
+  inline RansacModel regionToImageModel(const RansacModel& model, const vigra::Rect2D& rect, float imageScale) {
+    return RansacModel((Eigen::Transform2d(model) * Eigen::Translation2d(-rect.left() * imageScale, -rect.top() * imageScale)).matrix());
+  }
+
+} // namespace detail
+
+/**
+ * Matches a region of the given image against the given keypoint extract.
+ * Keypoints are extracted from the region only, at the same scale as they
+ * would be extracted from the whole image.
+ *
+ * @param scrImage                     Image to match.
+ * @param searchRect                   Region of the source image to extract
+ *                                     keypoints from. It is clipped to the
+ *                                     image.
+ * @param maxKeyImageSize              Maximal size of the whole source image
+ *                                     for keypoint extraction, see
+ *                                     extractKeypoints().
+ * @param keys                         Keypoint extract or descriptor index
+ *                                     of a keypoint template to match the
+ *                                     source image to.
+ * @param maxRansacError               Maximal RANSAC error used for keypoint
+ *                                     match filtering.
+ * @param useLma                       Perform transformation optimization with
+ *                                     Levenberg-Marquardt after initial
+ *                                     estimation via RANSAC?
+ * @param imageScale                   Scale of the original image relative
+ *                                     to the source image, see
+ *                                     extractKeypoints().
+ * @returns                            Transformation from original image
+ *                                     coordinates to extract coordinates.
+ */
+template<class PixelType, class VigraAlloc, class Keys>
+RansacModel matchModel(
+  const vigra::BasicImage<PixelType, VigraAlloc>& srcImage,
+  const vigra::Rect2D& searchRect,
+  const vigra::Size2D& maxKeyImageSize,
+  const Keys& keys,
+  double maxRansacError,
+  bool useLma,
+  float imageScale = 1.0f
+) {
+  vigra::Rect2D imageRect(vigra::Point2D(0, 0), srcImage.size());
+  vigra::Rect2D rect = searchRect & imageRect;
+  if(rect == imageRect)
+    return matchModel(srcImage, maxKeyImageSize, keys, maxRansacError, useLma, imageScale);
+  if(rect.isEmpty())
+    throw std::logic_error("Keypoint search region is empty.");
+
+  vigra::BasicImage<PixelType, VigraAlloc> regionImage(rect.size());
+  copyImage(srcImageRange(srcImage, rect), destImage(regionImage));
+  RansacModel model = matchModel(regionImage, detail::maxRegionKeyImageSize(srcImage.size(), rect, maxKeyImageSize), keys, maxRansacError, useLma, imageScale);
+  return detail::regionToImageModel(model, rect, imageScale);
+}
+
+/**
+ * Matches a region of the given image against an indexed keypoint template
+ * progressively, see progressiveMatchModel(). As in matchModel(), keypoints
+ * are extracted from the region only, at the same scale on each level as
+ * they would be extracted from the whole image.
+ *
+ * @param scrImage                     Image to match.
+ * @param searchRect                   Region of the source image to extract
+ *                                     keypoints from. It is clipped to the
+ *                                     image.
+ * @param maxKeyImageSize              Maximal size of the whole source image
+ *                                     for keypoint extraction on the last
+ *                                     level.
+ * @param index                        Descriptor index of the keypoint
+ *                                     template to match the source image to.
+ * @param maxRansacError               Maximal RANSAC error used for keypoint
+ *                                     match filtering.
+ * @param useLma                       Refine the transformation with least
+ *                                     squares, see matchModel().
+ * @param imageScale                   Scale of the original image relative
+ *                                     to the source image, see
+ *                                     extractKeypoints().
+ * @param[out] path                    If not NULL, receives the levels
+ *                                     tried, in order.
+ * @returns                            Transformation from original image
+ *                                     coordinates to template coordinates.
+ */
+template<class PixelType, class VigraAlloc>
+RansacModel progressiveMatchModel(
+  const vigra::BasicImage<PixelType, VigraAlloc>& srcImage,
+  const vigra::Rect2D& searchRect,
+  const vigra::Size2D& maxKeyImageSize,
+  const KeypointIndex& index,
+  double maxRansacError,
+  bool useLma,
+  float imageScale = 1.0f,
+  std::vector<MatchAttempt>* path = NULL
+) {
+  vigra::Rect2D imageRect(vigra::Point2D(0, 0), srcImage.size());
+  vigra::Rect2D rect = searchRect & imageRect;
+  if(rect == imageRect)
+    return progressiveMatchModel(srcImage, maxKeyImageSize, index, maxRansacError, useLma, imageScale, path);
+  if(rect.isEmpty())
+    throw std::logic_error("Keypoint search region is empty.");
+
+  RansacModel model = progressiveMatchModel(
+    vigra::make_triple(srcImage.upperLeft() + rect.upperLeft(), srcImage.upperLeft() + rect.lowerRight(), vigra::ConvertingAccessor<PixelType, float>()),
+    detail::maxRegionKeyImageSize(srcImage.size(), rect, maxKeyImageSize), 
+    index, 
+    maxRansacError, 
+    useLma, 
+    imageScale, 
+    path
+  );
+  return detail::regionToImageModel(model, rect, imageScale);
+}
+
+/**
+ * Verifies and refines the transformation of a previous image for the given
+ * image, see ScanTracker. This is much cheaper than matching, and succeeds
+ * for images of the same geometry, e.g. consecutive scans from a sheet
+ * feeder.
+ *
+ * @param tracker                      Tracker for the keypoint template.
+ * @param srcImage                     Image to match.
+ * @param imageScale                   Scale of the original image relative
+ *                                     to the source image, see
+ *                                     extractKeypoints().
+ * @param previousModel                Transformation of the previous image,
+ *                                     as returned by matchModel().
+ * @param[out] model                   Refined transformation from original
+ *                                     image coordinates to template
+ *                                     coordinates.
+ * @returns                            Whether the transformation was
+ *                                     verified.
+ */
+inline bool trackModel(const ScanTracker& tracker, const vigra::BImage& srcImage, float imageScale, const RansacModel& previousModel, RansacModel& model) {
+  Eigen::Transform2d transform = Eigen::Transform2d(previousModel);
+  std::complex<double> a(transform(0, 0), transform(1, 0));
+  std::complex<double> b(transform(0, 2), transform(1, 2));
+  if(!tracker(srcImage, imageScale, a, b))
+    return false;
+
+  model = similarityModel(a, b);
+  return true;
+}
+
+/**
+ * Matches the given image against the given keypoint extract and aligns it
+ * correspondingly.
+ *
+ * @param scrImage                     Image to match.
+ * @param maxKeyImageSize              Maximal size of an image to extract
+ *                                     keypoints from. Source image will be 
+ *                                     resized before keypoint extraction to
+ *                                     fit into this size.
+ * @param extract                      Keypoint extract to match the source
+ *                                     image to.
+ * @param[out] outImage                Aligned image.
+ * @param maxRansacError               Maximal RANSAC error used for keypoint
+ *                                     match filtering.
+ * @param useLma                       Perform transformation optimization with 
+ *                                     Levenberg-Marquardt after initial
+ *                                     estimation via RANSAC?
+ */
+template<class PixelType, class VigraAlloc, class Allocator>
+RansacModel match(
+  const vigra::BasicImage<PixelType, VigraAlloc>& srcImage, 
+  const vigra::Size2D& maxKeyImageSize,
+  const acv::Extract<Allocator>& extract, 
+  vigra::BasicImage<PixelType, VigraAlloc>& outImage, 
+  double maxRansacError, 
+  bool useLma
+) {
+  RansacModel model = matchModel(srcImage, maxKeyImageSize, extract, maxRansacError, useLma);
 
   /* Warp. */
   outImage.resize(extract.width(), extract.height());
@@ -124,31 +556,792 @@ RansacModel match(
   return model;
 }
 
+/**
+ * Matches the given image against an indexed keypoint template and aligns
+ * it correspondingly, see matchModel().
+ *
+ * @param scrImage                     Image to match.
+ * @param maxKeyImageSize              Maximal size of an image to extract
+ *                                     keypoints from, see extractKeypoints().
+ * @param index                        Descriptor index of the keypoint
+ *                                     template to match the source image to.
+ * @param[out] outImage                Aligned image.
+ * @param maxRansacError               Maximal RANSAC error used for keypoint
+ *                                     match filtering.
+ * @param useLma                       Refine the transformation with least
+ *                                     squares, see matchModel().
+ */
+template<class PixelType, class VigraAlloc>
+RansacModel match(
+  const vigra::BasicImage<PixelType, VigraAlloc>& srcImage, 
+  const vigra::Size2D& maxKeyImageSize,
+  const KeypointIndex& index, 
+  vigra::BasicImage<PixelType, VigraAlloc>& outImage, 
+  double maxRansacError, 
+  bool useLma
+) {
+  RansacModel model = matchModel(srcImage, maxKeyImageSize, index, maxRansacError, useLma);
+
+  /* Warp. */
+  outImage.resize(index.keys().width(), index.keys().height());
+  outImage.init(vigra::white<PixelType>());
+  warpImage(srcImage, outImage, model);
+
+  /* Ok. */
+  return model;
+}
+
+/**
+ * Matches a decoded image against an indexed keypoint template
+ * progressively, see progressiveMatchModel(), and aligns it correspondingly.
+ * Keypoints are extracted from the luminance of the decoded pixels and the
+ * aligned image is resampled right from them, so the image is not copied.
+ *
+ * @param image                        Image to match, in Format_RGB32 or
+ *                                     Format_ARGB32, see loadImage().
+ * @param maxKeyImageSize              Maximal size of an image to extract
+ *                                     keypoints from, see extractKeypoints().
+ * @param index                        Descriptor index of the keypoint
+ *                                     template to match the image to.
+ * @param[out] outImage                Aligned image.
+ * @param maxRansacError               Maximal RANSAC error used for keypoint
+ *                                     match filtering.
+ * @param useLma                       Refine the transformation with least
+ *                                     squares, see matchModel().
+ * @param[out] path                    If not NULL, receives the matching
+ *                                     levels tried, see
+ *                                     progressiveMatchModel().
+ */
+inline RansacModel match(
+  const QImage& image, 
+  const vigra::Size2D& maxKeyImageSize,
+  const KeypointIndex& index, 
+  vigra::BRGBImage& outImage, 
+  double maxRansacError, 
+  bool useLma,
+  std::vector<MatchAttempt>* path = NULL
+) {
+  vigra::BasicImageView<QRgb> view = rgb32View(image);
+  RansacModel model = progressiveMatchModel(srcImageRange(view, QRgbGrayAccessor()), maxKeyImageSize, index, maxRansacError, useLma, 1.0f, path);
+
+  /* Warp. */
+  outImage.resize(index.keys().width(), index.keys().height());
+  outImage.init(vigra::white<vigra::RGBValue<vigra::UInt8> >());
+  warpImage(srcImageRange(view, QRgbAccessor()), outImage, model);
+
+  /* Ok. */
+  return model;
+}
+
+/**
+ * Matches a mapped grayscale image against an indexed keypoint template and
+ * aligns it correspondingly, see matchModel(). Keypoints are extracted and
+ * the aligned image is resampled right from the mapped file, so the image
+ * is neither decoded nor copied.
+ *
+ * @param image                        Image to match, must be in GRAY8
+ *                                     format.
+ * @param maxKeyImageSize              Maximal size of an image to extract
+ *                                     keypoints from, see extractKeypoints().
+ * @param index                        Descriptor index of the keypoint
+ *                                     template to match the image to.
+ * @param[out] outImage                Aligned image.
+ * @param maxRansacError               Maximal RANSAC error used for keypoint
+ *                                     match filtering.
+ * @param useLma                       Refine the transformation with least
+ *                                     squares, see matchModel().
+ */
+inline RansacModel match(
+  const MappedImage& image,
+  const vigra::Size2D& maxKeyImageSize,
+  const KeypointIndex& index,
+  vigra::BImage& outImage,
+  double maxRansacError,
+  bool useLma
+) {
+  assert(image.format() == MappedImage::GRAY8);
+
+  RansacModel model = matchModel(vigra::make_triple(image.grayUpperLeft(), image.grayLowerRight(), vigra::ConvertingAccessor<vigra::UInt8, float>()), maxKeyImageSize, index, maxRansacError, useLma);
+
+  /* Warp. */
+  outImage.resize(index.keys().width(), index.keys().height());
+  outImage.init(vigra::white<vigra::UInt8>());
+  warpImage(vigra::make_triple(image.grayUpperLeft(), image.grayLowerRight(), vigra::StandardConstValueAccessor<vigra::UInt8>()), outImage, model);
+
+  /* Ok. */
+  return model;
+}
+
+/**
+ * Finds the part of an image that is mapped into the given region of a
+ * keypoint extract.
+ *
+ * @param model                        Transformation from image coordinates
+ *                                     to extract coordinates, as returned
+ *                                     by matchModel().
+ * @param rect                         Region in extract coordinates.
+ * @returns                            Bounding box of the region in image
+ *                                     coordinates, with a margin for spline
+ *                                     interpolation. It is not clipped to
+ *                                     the image.
+ */
+inline vigra::Rect2D sourceRect(const RansacModel& model, const vigra::Rect2D& rect) {
+  /* See important note in warpImage() on the inversion. */
+  Eigen::Transform2d srcToDstTransform = Eigen::Transform2d(model);
+  Eigen::Transform2d dstToSrcTransform = Eigen::Transform2d(srcToDstTransform.matrix().lu().inverse());
+  double minX = std::numeric_limits<double>::max(), minY = minX, maxX = -minX, maxY = -minX;
+  for(int i = 0; i < 4; i++) {
+    Eigen::Vector2d v = dstToSrcTransform * Eigen::Vector2d(i % 2 == 0 ? rect.left() : rect.right(), i / 2 == 0 ? rect.top() : rect.bottom());
+    minX = std::min(minX, v[0]);
+    minY = std::min(minY, v[1]);
+    maxX = std::max(maxX, v[0]);
+    maxY = std::max(maxY, v[1]);
+  }
+
+  const int margin = 3;
+  return vigra::Rect2D(
+    static_cast<int>(std::floor(minX)) - margin, 
+    static_cast<int>(std::floor(minY)) - margin, 
+    static_cast<int>(std::ceil(maxX)) + margin + 1, 
+    static_cast<int>(std::ceil(maxY)) + margin + 1
+  );
+}
+
+/**
+ * Aligns a region of an image with a keypoint extract. Only the part of the
+ * image that is mapped into the region is resampled.
+ *
+ * @param src                          Image to align, given as a vigra
+ *                                     source range, e.g. rgb32View() with
+ *                                     QRgbAccessor.
+ * @param model                        Transformation from image coordinates
+ *                                     to extract coordinates, as returned
+ *                                     by matchModel().
+ * @param rect                         Region to align, in extract
+ *                                     coordinates.
+ * @param[out] outImage                Aligned region.
+ */
+template<class SrcIterator, class SrcAccessor, class PixelType, class Alloc>
+void warpRegion(vigra::triple<SrcIterator, SrcIterator, SrcAccessor> src, const RansacModel& model, const vigra::Rect2D& rect, vigra::BasicImage<PixelType, Alloc>& outImage) {
+  outImage.resize(rect.size());
+  outImage.init(vigra::white<PixelType>());
+
+  vigra::Rect2D srcRect = sourceRect(model, rect) & vigra::Rect2D(vigra::Point2D(0, 0), vigra::Size2D(src.second - src.first));
+  if(srcRect.isEmpty())
+    return;
+
+  warpImage(vigra::make_triple(src.first + srcRect.upperLeft(), src.first + srcRect.lowerRight(), src.third), outImage, Eigen::Translation2d(-rect.left(), -rect.top()) * Eigen::Transform2d(model) * Eigen::Translation2d(srcRect.left(), srcRect.top()));
+}
+
+/**
+ * Aligns a region of an image with a keypoint extract, see above.
+ */
+template<class PixelType, class Alloc>
+void warpRegion(const vigra::BasicImage<PixelType, Alloc>& srcImage, const RansacModel& model, const vigra::Rect2D& rect, vigra::BasicImage<PixelType, Alloc>& outImage) {
+  warpRegion(srcImageRange(srcImage), model, rect, outImage);
+}
+
+/**
+ * Aligns a region of an encoded image with a keypoint extract. Only the
+ * part of the image that is mapped into the region is decoded at full
+ * resolution.
+ *
+ * @param image                        Image to align.
+ * @param model                        Transformation from image coordinates
+ *                                     to extract coordinates, as returned
+ *                                     by matchModel().
+ * @param rect                         Region to align, in extract
+ *                                     coordinates.
+ * @param[out] outImage                Aligned region.
+ */
+inline void warpRegion(EncodedImage& image, const RansacModel& model, const vigra::Rect2D& rect, vigra::BImage& outImage) {
+  outImage.resize(rect.size());
+  outImage.init(vigra::white<vigra::UInt8>());
+
+  vigra::BImage regionImage;
+  vigra::Rect2D srcRect = image.region(sourceRect(model, rect), regionImage);
+  if(srcRect.isEmpty())
+    return;
+
+  warpImage(regionImage, outImage, Eigen::Translation2d(-rect.left(), -rect.top()) * Eigen::Transform2d(model) * Eigen::Translation2d(srcRect.left(), srcRect.top()));
+}
+
+/**
+ * Barcode recognition parameters.
+ */
+struct RecognitionParams {
+  RecognitionParams(): 
+    minIterations(DEFAULT_MIN_ITERATIONS), 
+    maxIterations(DEFAULT_MAX_ITERATIONS), 
+    checkSum(false), 
+    threadCount(DEFAULT_RECOGNITION_THREADS), 
+    seed(DEFAULT_RECOGNITION_SEED), 
+    stopMargin(DEFAULT_STOP_MARGIN),
+    sampler(DEFAULT_SAMPLER),
+    accumulator(DEFAULT_ACCUMULATOR),
+    edgeDetector(DEFAULT_EDGE_DETECTOR),
+    decoder(DEFAULT_DECODER),
+    codeLength(DEFAULT_CODE_LENGTH),
+    voting(DEFAULT_VOTING)
+  {}
+
+  /**
+   * Configures the given recognizer according to these parameters.
+   */
+  void apply(barcode::ItfRecognizer& recognizer) const {
+    recognizer.setThreadCount(threadCount);
+    recognizer.setSeed(seed);
+    recognizer.setStopMargin(stopMargin);
+    recognizer.setAccumulator(accumulator);
+    recognizer.setEdgeDetector(edgeDetector);
+    recognizer.setDecoder(decoder);
+    recognizer.setVoting(voting);
+
+    barcode::ItfSchema codeSchema = schema;
+    if(codeLength != 0)
+      codeSchema.setLength(codeLength);
+    if(checkSum)
+      codeSchema.setCheckSum(true);
+    recognizer.setSchema(codeSchema);
+  }
+
+  /** Minimal number of recognition iterations. */
+  int minIterations;
+
+  /** Maximal number of recognition iterations. */
+  int maxIterations;
+
+  /** Check ITF checksum? */
+  bool checkSum;
+
+  /** Number of recognition threads, zero for the number of hardware threads. */
+  int threadCount;
+
+  /** Recognition seed. */
+  unsigned seed;
+
+  /** Vote margin for early stopping, zero to disable. */
+  int stopMargin;
+
+  /** Scanline interpolation method. */
+  barcode::ItfRecognizer::Sampler sampler;
+
+  /** Scanline accumulation method. */
+  barcode::ItfRecognizer::Accumulator accumulator;
+
+  /** Segment width measurement method. */
+  barcode::ItfRecognizer::EdgeDetector edgeDetector;
+
+  /** Segment width decoding method. */
+  barcode::ItfRecognizer::Decoder decoder;
+
+  /** Number of digits in the barcode, zero if not known. */
+  int codeLength;
+
+  /** Trial voting method. */
+  barcode::ItfRecognizer::Voting voting;
+
+  /** Known structure of the barcode. Code length and checksum settings are 
+   * added to it. */
+  barcode::ItfSchema schema;
+};
+
+namespace barcode {
+  /**
+   * Validation function for barcode::ItfRecognizer::Sampler command line 
+   * parameter.
+   */
+  inline void validate(boost::any& v, const std::vector<std::string>& values, ItfRecognizer::Sampler* target_type, int) {
+    using namespace boost::program_options;
+
+    validators::check_first_occurrence(v);
+    const std::string& s = validators::get_single_string(values);
+
+    if(s == "spline")
+      v = ItfRecognizer::SPLINE_SAMPLER;
+    else if(s == "bilinear")
+      v = ItfRecognizer::BILINEAR_SAMPLER;
+    else if(s == "nearest")
+      v = ItfRecognizer::NEAREST_SAMPLER;
+    else
+      throw invalid_option_value(s);
+  }
+
+  /**
+   * Validation function for barcode::ItfRecognizer::Accumulator command line 
+   * parameter.
+   */
+  inline void validate(boost::any& v, const std::vector<std::string>& values, ItfRecognizer::Accumulator* target_type, int) {
+    using namespace boost::program_options;
+
+    validators::check_first_occurrence(v);
+    const std::string& s = validators::get_single_string(values);
+
+    if(s == "lines")
+      v = ItfRecognizer::LINE_ACCUMULATOR;
+    else if(s == "projection")
+      v = ItfRecognizer::PROJECTION_ACCUMULATOR;
+    else
+      throw invalid_option_value(s);
+  }
+
+  /**
+   * Validation function for barcode::ItfRecognizer::EdgeDetector command line 
+   * parameter.
+   */
+  inline void validate(boost::any& v, const std::vector<std::string>& values, ItfRecognizer::EdgeDetector* target_type, int) {
+    using namespace boost::program_options;
+
+    validators::check_first_occurrence(v);
+    const std::string& s = validators::get_single_string(values);
+
+    if(s == "binary")
+      v = ItfRecognizer::BINARY_EDGE_DETECTOR;
+    else if(s == "subpixel")
+      v = ItfRecognizer::SUBPIXEL_EDGE_DETECTOR;
+    else
+      throw invalid_option_value(s);
+  }
+
+  /**
+   * Validation function for barcode::ItfRecognizer::Decoder command line 
+   * parameter.
+   */
+  inline void validate(boost::any& v, const std::vector<std::string>& values, ItfRecognizer::Decoder* target_type, int) {
+    using namespace boost::program_options;
+
+    validators::check_first_occurrence(v);
+    const std::string& s = validators::get_single_string(values);
+
+    if(s == "hard")
+      v = ItfRecognizer::HARD_DECODER;
+    else if(s == "soft")
+      v = ItfRecognizer::SOFT_DECODER;
+    else
+      throw invalid_option_value(s);
+  }
+
+  /**
+   * Validation function for barcode::ItfRecognizer::Voting command line 
+   * parameter.
+   */
+  inline void validate(boost::any& v, const std::vector<std::string>& values, ItfRecognizer::Voting* target_type, int) {
+    using namespace boost::program_options;
+
+    validators::check_first_occurrence(v);
+    const std::string& s = validators::get_single_string(values);
+
+    if(s == "code")
+      v = ItfRecognizer::CODE_VOTING;
+    else if(s == "digit")
+      v = ItfRecognizer::DIGIT_VOTING;
+    else
+      throw invalid_option_value(s);
+  }
+}
+
+/**
+ * Adds barcode recognition options to the given options description.
+ *
+ * @param desc                         Options description.
+ * @param params                       Recognition parameters to store 
+ *                                     option values into.
+ */
+inline void addRecognitionOptions(boost::program_options::options_description& desc, RecognitionParams& params) {
+  using namespace boost::program_options;
+
+  desc.add_options()
+    ("checksum,c",       bool_switch(&params.checkSum),     "Check mod 10 checksum.")
+    ("min-iterations",   value<int>(&params.minIterations)->default_value(DEFAULT_MIN_ITERATIONS),
+                                                            "Minimal number of iterations.")
+    ("max-iterations",   value<int>(&params.maxIterations)->default_value(DEFAULT_MAX_ITERATIONS), 
+                                                            "Maximal number of iterations.")
+    ("stop-margin",      value<int>(&params.stopMargin)->default_value(DEFAULT_STOP_MARGIN),
+                                                            "Stop as soon as a barcode with a valid checksum is this many votes ahead, 0 to disable.")
+    ("threads,t",        value<int>(&params.threadCount)->default_value(DEFAULT_RECOGNITION_THREADS),
+                                                            "Number of recognition threads, 0 for the number of hardware threads.")
+    ("seed",             value<unsigned>(&params.seed)->default_value(DEFAULT_RECOGNITION_SEED),
+                                                            "Recognition seed.")
+    ("sampler",          value<barcode::ItfRecognizer::Sampler>(&params.sampler)->default_value(DEFAULT_SAMPLER, "spline"),
+                                                            "Scanline interpolation method, one of spline, bilinear or nearest.")
+    ("accumulator",      value<barcode::ItfRecognizer::Accumulator>(&params.accumulator)->default_value(DEFAULT_ACCUMULATOR, "lines"),
+                                                            "Scanline accumulation method, one of lines or projection.")
+    ("edges",            value<barcode::ItfRecognizer::EdgeDetector>(&params.edgeDetector)->default_value(DEFAULT_EDGE_DETECTOR, "binary"),
+                                                            "Segment width measurement method, one of binary or subpixel.")
+    ("decoder",          value<barcode::ItfRecognizer::Decoder>(&params.decoder)->default_value(DEFAULT_DECODER, "hard"),
+                                                            "Segment width decoding method, one of hard or soft.")
+    ("code-length",      value<int>(&params.codeLength)->default_value(DEFAULT_CODE_LENGTH),
+                                                            "Number of digits in the barcode, 0 if not known.")
+    ("voting",           value<barcode::ItfRecognizer::Voting>(&params.voting)->default_value(DEFAULT_VOTING, "code"),
+                                                            "Trial voting method, one of code or digit.");
+}
+
 /**
  * Recognizes barcode in a given image.
  *
+ * All recognition buffers, including the copy of the barcode region, are
+ * kept in the given context, so that recognizing a batch of barcodes with a
+ * single context doesn't allocate once the buffers have grown.
+ *
  * @param img                          Image that contains the barcode.
  * @param barcodePos                   Position of the barcode in an image.
- * @param minIterations                Minimal number of recognition iterations.
- * @param maxIterations                Maximal number of recognition iterations.
- * @param checkSum                     Check ITF checksum?
- * @returns                            Recognized barcode.
+ * @param params                       Recognition parameters.
+ * @param context                      Recognition context.
+ * @param result[out]                  Recognition result.
  */
 template<class PixelType, class Alloc>
-barcode::ItfCode recognize(const vigra::BasicImage<PixelType, Alloc>& img, const vigra::Rect2D& barcodePos, int minIterations, int maxIterations, bool checkSum) {
-  vigra::BImage codeImage(barcodePos.size());
+void recognize(const vigra::BasicImage<PixelType, Alloc>& img, const vigra::Rect2D& barcodePos, const RecognitionParams& params, barcode::ItfRecognizerContext& context, barcode::ItfResult& result) {
+  vigra::BImage& codeImage = context.image();
+  codeImage.resize(barcodePos.size());
   copyImage(srcImageRange(img, barcodePos, vigra::ConvertingAccessor<PixelType, vigra::UInt8>()), destImage(codeImage));
 
-  barcode::ItfCode result = barcode::ItfRecognizer(codeImage)(minIterations, maxIterations);
-  if(result.size() == 0)
+  barcode::ItfRecognizer recognizer(codeImage, params.sampler, context);
+  params.apply(recognizer);
+  recognizer.run(params.minIterations, params.maxIterations, result);
+  if(result.code().size() == 0)
     throw std::logic_error("Could not recognize barcode.");
-  if(checkSum && result.mod10CheckSum() != 0)
-    throw std::logic_error("Wrong checksum: " + boost::lexical_cast<std::string>(result.mod10CheckSum()) + " instead of 0 for barcode " + result.string());
+  if(params.checkSum && result.code().mod10CheckSum() != 0)
+    throw std::logic_error("Wrong checksum: " + boost::lexical_cast<std::string>(result.code().mod10CheckSum()) + " instead of 0 for barcode " + result.code().string());
+}
+
+/**
+ * Recognizes barcode in a given image.
+ *
+ * @param img                          Image that contains the barcode.
+ * @param barcodePos                   Position of the barcode in an image.
+ * @param params                       Recognition parameters.
+ * @returns                            Recognition result.
+ */
+template<class PixelType, class Alloc>
+barcode::ItfResult recognize(const vigra::BasicImage<PixelType, Alloc>& img, const vigra::Rect2D& barcodePos, const RecognitionParams& params) {
+  barcode::ItfRecognizerContext context;
+  barcode::ItfResult result;
+  recognize(img, barcodePos, params, context, result);
   return result;
 }
 
 /**
- * Loads keypoint extract from a file.
+ * Recognizes a barcode at the given location, trying both reading
+ * directions. Only clean reads are accepted, i.e. results that are at least
+ * stop margin votes ahead and pass the checksum if it is checked.
+ *
+ * @param img                          Image that contains the barcode.
+ * @param location                     Location of the barcode.
+ * @param params                       Recognition parameters.
+ * @param context                      Recognition context.
+ * @param flipped[out]                 Whether the barcode was read in the
+ *                                     flipped direction.
+ * @param result[out]                  Recognition result.
+ * @returns                            Whether the barcode was read cleanly.
+ */
+inline bool recognizeAt(const vigra::BImage& img, const barcode::ItfLocation& location, const RecognitionParams& params, barcode::ItfRecognizerContext& context, bool& flipped, barcode::ItfResult& result) {
+  vigra::BImage& codeImage = context.image();
+  for(int flip = 0; flip < 2; flip++) {
+    barcode::ItfLocator::crop(img, flip ? location.flipped() : location, codeImage);
+
+    barcode::ItfRecognizer recognizer(codeImage, params.sampler, context);
+    params.apply(recognizer);
+    recognizer.run(params.minIterations, params.maxIterations, result);
+    if(result.code().size() == 0 || result.margin() < std::max(params.stopMargin, 1))
+      continue;
+    if(params.checkSum && result.code().mod10CheckSum() != 0)
+      continue;
+    flipped = flip != 0;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @param params                       Recognition parameters.
+ * @returns                            Recognition parameters for a probe
+ *                                     read at a located position, limited
+ *                                     to the minimal number of iterations.
+ *                                     A clean barcode reaches the stop
+ *                                     margin within them, while a located
+ *                                     table or text block would otherwise
+ *                                     use up all iterations in vain.
+ */
+inline RecognitionParams probeParams(const RecognitionParams& params) {
+  RecognitionParams result = params;
+  result.maxIterations = std::min(params.minIterations, params.maxIterations);
+  return result;
+}
+
+/**
+ * Finds a barcode in an image at any angle and recognizes it.
+ *
+ * Unlike recognize(), this function doesn't need the image to be aligned
+ * with a template, but only accepts clean reads, see recognizeAt(), and
+ * only runs the minimal number of iterations, see probeParams(). Caller is
+ * expected to fall back to template matching otherwise.
+ *
+ * @param img                          Image that contains the barcode.
+ * @param params                       Recognition parameters.
+ * @returns                            Recognition result, with empty code if
+ *                                     the barcode wasn't read cleanly.
+ */
+inline barcode::ItfResult locateAndRecognize(const vigra::BImage& img, const RecognitionParams& params) {
+  barcode::ItfLocation location = barcode::ItfLocator()(img);
+  if(location.isEmpty())
+    return barcode::ItfResult();
+
+  barcode::ItfRecognizerContext context;
+  barcode::ItfResult result;
+  bool flipped;
+  if(!recognizeAt(img, location, probeParams(params), context, flipped, result))
+    return barcode::ItfResult();
+  return result;
+}
+
+/**
+ * Finds a barcode in an encoded image at any angle and recognizes it.
+ *
+ * Barcode is located in the reduced image, see EncodedImage::reduced(), and
+ * is then recognized in a full-resolution region around its location, so
+ * the image is never decoded as a whole at full resolution. As in
+ * locateAndRecognize(), only clean reads within the minimal number of
+ * iterations are accepted.
+ *
+ * @param image                        Image that contains the barcode.
+ * @param maxKeyImageSize              Maximal size of an image to extract
+ *                                     keypoints from, see
+ *                                     EncodedImage::reduced().
+ * @param params                       Recognition parameters.
+ * @returns                            Recognition result, with empty code if
+ *                                     the barcode wasn't read cleanly.
+ */
+inline barcode::ItfResult locateAndRecognize(EncodedImage& image, const vigra::Size2D& maxKeyImageSize, const RecognitionParams& params) {
+  barcode::ItfLocation location = barcode::ItfLocator()(image.reduced(maxKeyImageSize));
+  if(location.isEmpty())
+    return barcode::ItfResult();
+
+  /* Pixel of the reduced image covers a square of full-resolution pixels. 
+   * Location is only as precise as the reduced image, so the region is 
+   * extended by a few reduced pixels. */
+  int reduction = image.reduction();
+  location = location.scaled(reduction).translated(0.5 * (reduction - 1), 0.5 * (reduction - 1));
+  double margin = 4.0 * reduction;
+  vigra::BImage regionImage;
+  vigra::Rect2D rect = image.region(vigra::Rect2D(
+    static_cast<int>(location.x() - location.xExtent() - margin),
+    static_cast<int>(location.y() - location.yExtent() - margin),
+    static_cast<int>(location.x() + location.xExtent() + margin) + 1,
+    static_cast<int>(location.y() + location.yExtent() + margin) + 1
+  ), regionImage);
+  if(rect.isEmpty())
+    return barcode::ItfResult();
+
+  barcode::ItfRecognizerContext context;
+  barcode::ItfResult result;
+  bool flipped;
+  if(!recognizeAt(regionImage, location.translated(-rect.left(), -rect.top()), probeParams(params), context, flipped, result))
+    return barcode::ItfResult();
+  return result;
+}
+
+/**
+ * Worker pool that recognizes barcodes at a list of candidate locations.
+ * Each worker thread has a recognition context of its own.
+ */
+class LocationRecognizer: public boost::noncopyable {
+public:
+  LocationRecognizer(const vigra::BImage& img, const std::vector<barcode::ItfLocation>& locations, const RecognitionParams& params):
+    mImg(img), mLocations(locations), mParams(params), mResults(locations.size()), mFlipped(locations.size(), false), mRead(locations.size(), false), mNext(0) {}
+
+  /**
+   * Recognizes barcodes at all locations.
+   *
+   * @param threadCount                Number of worker threads.
+   */
+  void run(int threadCount) {
+    boost::thread_group threads;
+    for(int i = 0; i < threadCount; i++)
+      threads.create_thread(boost::bind(&LocationRecognizer::work, this));
+    threads.join_all();
+  }
+
+  /**
+   * Appends barcodes that were read cleanly to the given vector, in the
+   * order of locations. Barcodes that were already read at a previous
+   * location are skipped.
+   */
+  void detections(std::vector<barcode::ItfDetection>& detections) const {
+    for(std::size_t i = 0; i < mLocations.size(); i++) {
+      if(!mRead[i])
+        continue;
+
+      bool duplicate = false;
+      for(std::size_t j = 0; j < detections.size() && !duplicate; j++)
+        duplicate = detections[j].code() == mResults[i].code();
+      if(!duplicate)
+        detections.push_back(barcode::ItfDetection(mFlipped[i] ? mLocations[i].flipped() : mLocations[i], mResults[i]));
+    }
+  }
+
+private:
+  void work() {
+    barcode::ItfRecognizerContext context;
+    while(true) {
+      int index;
+      {
+        boost::mutex::scoped_lock lock(mMutex);
+        if(mNext >= static_cast<int>(mLocations.size()))
+          return;
+        index = mNext++;
+      }
+
+      bool flipped = false;
+      bool read = recognizeAt(mImg, mLocations[index], mParams, context, flipped, mResults[index]);
+      mFlipped[index] = flipped;
+      mRead[index] = read;
+    }
+  }
+
+  const vigra::BImage& mImg;
+  const std::vector<barcode::ItfLocation>& mLocations;
+  const RecognitionParams& mParams;
+  std::vector<barcode::ItfResult> mResults;
+  std::vector<char> mFlipped;
+  std::vector<char> mRead;
+  int mNext;
+  boost::mutex mMutex;
+};
+
+/**
+ * Finds all barcodes in an image at any angle and recognizes them.
+ *
+ * Gradients of the whole image are computed once by ItfLocator, and the
+ * candidates it finds are then recognized in parallel, in params.threadCount
+ * threads. When there is more than one candidate, each one is recognized
+ * in a single thread. As in locateAndRecognize(), only clean reads within
+ * the minimal number of iterations are reported.
+ *
+ * @param img                          Image to search.
+ * @param params                       Recognition parameters.
+ * @param detections[out]              Recognized barcodes with their
+ *                                     locations, best candidates first. A
+ *                                     barcode found at several locations
+ *                                     is reported once.
+ */
+inline void locateAndRecognizeAll(const vigra::BImage& img, const RecognitionParams& params, std::vector<barcode::ItfDetection>& detections) {
+  detections.clear();
+
+  std::vector<barcode::ItfLocation> locations;
+  barcode::ItfLocator().locate(img, locations);
+  if(locations.empty())
+    return;
+
+  int threadCount = params.threadCount != 0 ? params.threadCount : std::max(1u, boost::thread::hardware_concurrency());
+  threadCount = std::min(threadCount, static_cast<int>(locations.size()));
+
+  RecognitionParams candidateParams = probeParams(params);
+  if(threadCount > 1)
+    candidateParams.threadCount = 1;
+
+  LocationRecognizer recognizer(img, locations, candidateParams);
+  recognizer.run(threadCount);
+  recognizer.detections(detections);
+}
+
+/**
+ * Loads an image file and converts it to grayscale. Uncompressed files are
+ * copied right from the mapped file, see MappedImage, and JPEG files are
+ * decoded directly into luma if possible, see EncodedImage.
+ *
+ * @param[out] img                     Loaded image.
+ * @param fileName                     Filename of the image.
+ */
+inline void loadImage(vigra::BImage& img, const std::string& fileName) {
+  MappedImage mapped(fileName);
+  if(mapped.isMapped()) {
+    mapped.region(vigra::Rect2D(vigra::Point2D(0, 0), mapped.size()), img);
+    return;
+  }
+
+  QFile file(QString::fromLocal8Bit(fileName.c_str()));
+  if(!file.open(QIODevice::ReadOnly))
+    throw std::logic_error("Could not open image \"" + fileName + "\".");
+
+  QByteArray contents = file.readAll();
+  try {
+    EncodedImage(reinterpret_cast<const uchar*>(contents.constData()), contents.size()).decode(img);
+  } catch(std::logic_error&) {
+    throw std::logic_error("Could not load image \"" + fileName + "\".");
+  }
+}
+
+/**
+ * Loads the part of an image file that contains a barcode. Only the rows 
+ * of the barcode are read from uncompressed files, see MappedImage, other
+ * files are loaded as a whole.
+ *
+ * @param[out] img                     Loaded image.
+ * @param fileName                     Filename of the image.
+ * @param[in,out] barcodePos           Barcode position in the image file,
+ *                                     negative sizes are counted from the
+ *                                     image size. On return, barcode
+ *                                     position in the loaded image.
+ */
+inline void loadBarcodeImage(vigra::BImage& img, const std::string& fileName, vigra::Rect2D& barcodePos) {
+  MappedImage mapped(fileName);
+  vigra::Size2D size = mapped.size();
+  if(!mapped.isMapped()) {
+    loadImage(img, fileName);
+    size = img.size();
+  }
+
+  fixNegativeSize(&barcodePos, size);
+  if(!vigra::Rect2D(vigra::Point2D(0, 0), size).contains(barcodePos))
+    throw std::logic_error("Specified barcode position lies outside the input image boundaries.");
+
+  if(mapped.isMapped()) {
+    mapped.region(barcodePos, img);
+    barcodePos = vigra::Rect2D(vigra::Point2D(0, 0), barcodePos.size());
+  }
+}
+
+/**
+ * Loads an image file as a 32-bit QImage. Its pixels are used by vigra
+ * algorithms right from the decoded memory, see rgb32View(), so images that
+ * are only read don't need a copy.
+ *
+ * @param[out] image                   Loaded image, in Format_RGB32 or
+ *                                     Format_ARGB32.
+ * @param fileName                     Filename of the image.
+ */
+inline void loadImage(QImage& image, const std::string& fileName) {
+  if(!image.load(QString::fromLocal8Bit(fileName.c_str())))
+    throw std::logic_error("Could not load image \"" + fileName + "\".");
+
+  if(image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32)
+    image = image.convertToFormat(QImage::Format_RGB32);
+}
+
+/**
+ * Loads an image file as a color image that can be modified. Uncompressed
+ * files are copied right from the mapped file, see MappedImage, other files
+ * are converted right from the decoded QImage memory, see rgb32View().
+ *
+ * @param[out] img                     Loaded image.
+ * @param fileName                     Filename of the image.
+ */
+inline void loadImage(vigra::BRGBImage& img, const std::string& fileName) {
+  MappedImage mapped(fileName);
+  if(mapped.isMapped()) {
+    mapped.region(vigra::Rect2D(vigra::Point2D(0, 0), mapped.size()), img);
+    return;
+  }
+
+  QImage image;
+  loadImage(image, fileName);
+  img.resize(image.width(), image.height());
+  copyImage(srcImageRange(rgb32View(image), QRgbAccessor()), destImage(img));
+}
+
+/**
+ * Loads keypoint extract from a file in acv text format. Binary keypoint
+ * templates are matched with the descriptor index only, see cachedIndex().
  * 
  * @param[out] extract                 Extract to load.
  * @param fileName                     Filename of the extract.
@@ -162,4 +1355,60 @@ void loadExtract(acv::Extract<Allocator>& extract, std::string fileName) {
   f.close();
 }
 
+namespace detail {
+  struct KeypointCache {
+    boost::mutex mutex;
+    std::map<std::string, boost::shared_ptr<const KeypointTemplate> > templates;
+    std::map<std::string, boost::shared_ptr<const KeypointIndex> > indices;
+  };
+
+  inline KeypointCache*& keypointCacheInstance() {
+    static KeypointCache* instance = NULL;
+    return instance;
+  }
+
+  inline void createKeypointCache() {
+    keypointCacheInstance() = new KeypointCache();
+  }
+
+  inline KeypointCache& keypointCache() {
+    static boost::once_flag flag = BOOST_ONCE_INIT;
+    boost::call_once(flag, &createKeypointCache);
+    return *keypointCacheInstance();
+  }
+
+} // namespace detail
+
+/**
+ * Loads keypoint template and its descriptor index. Each file is loaded
+ * only once per process, subsequent calls return the same index.
+ *
+ * This function is thread-safe.
+ *
+ * @param keysFileName                 Filename of the keypoint template, may
+ *                                     be a Qt resource path.
+ * @param indexFileName                Filename of the descriptor index, see
+ *                                     KeypointIndex. If empty, the index is
+ *                                     built in memory.
+ * @returns                            Loaded index, valid until the process
+ *                                     exits.
+ */
+inline const KeypointIndex& cachedIndex(const std::string& keysFileName, const std::string& indexFileName = std::string()) {
+  detail::KeypointCache& cache = detail::keypointCache();
+
+  boost::mutex::scoped_lock lock(cache.mutex);
+  boost::shared_ptr<const KeypointTemplate>& keys = cache.templates[keysFileName];
+  if(!keys)
+    keys.reset(new KeypointTemplate(keysFileName));
+
+  boost::shared_ptr<const KeypointIndex>& result = cache.indices[keysFileName + "\n" + indexFileName];
+  if(!result) {
+    if(indexFileName.empty())
+      result.reset(new KeypointIndex(*keys));
+    else
+      result.reset(new KeypointIndex(*keys, indexFileName));
+  }
+  return *result;
+}
+
 #endif // COMMON_H
@@ -0,0 +1,361 @@
+#ifndef ENCODED_IMAGE_H
+#define ENCODED_IMAGE_H
+
+#include "config.h"
+#include <algorithm> /* for std::min() and std::max() */
+#include <stdexcept> /* for std::logic_error */
+#include <QByteArray>
+#include <QBuffer>
+#include <QImage>
+#include <QImageReader>
+#include <QImageIOHandler>
+#include <vigra/stdimage.hxx>
+#include "QImageViews.h"
+#ifdef BRT_USE_LIBJPEG
+#  include <cstdio> /* jpeglib.h needs FILE and size_t. */
+#  include <csetjmp>
+#  include <jpeglib.h>
+#endif
+
+// -------------------------------------------------------------------------- //
+// EncodedImage
+// -------------------------------------------------------------------------- //
+/**
+ * Image file that is already in memory, decoded to grayscale on demand.
+ *
+ * Decoding full-resolution scans is expensive, and most of the pixels are
+ * never needed at full resolution: keypoints are extracted from an image
+ * that fits into a small size, and barcodes are recognized in small
+ * regions. EncodedImage therefore decodes a reduced image and separate
+ * full-resolution regions.
+ *
+ * For JPEG files, reduced image is decoded at 1/2, 1/4 or 1/8 resolution
+ * by the JPEG decoder itself, in the DCT domain, and only regions that were
+ * asked for are kept at full resolution. For formats that can't be decoded
+ * this way, the whole image is decoded once at full resolution and serves
+ * both purposes.
+ *
+ * When built with BRT_USE_LIBJPEG defined, JPEG files are decoded with 
+ * libjpeg directly into 8-bit luma, so that chroma components of YCbCr
+ * images are neither decoded nor converted through RGB. Luma then follows
+ * the JPEG definition, which weights the color components slightly
+ * differently than qGray() does. Other images, and JPEG images libjpeg can't
+ * convert to grayscale, are decoded by Qt.
+ *
+ * EncodedImage doesn't copy the file contents, so these must outlive it.
+ */
+class EncodedImage {
+public:
+  /**
+   * Constructor.
+   *
+   * @param data                       Contents of an image file.
+   * @param size                       Size of the file, in bytes.
+   */
+  EncodedImage(const uchar* data, int size):
+    mData(QByteArray::fromRawData(reinterpret_cast<const char*>(data), size)), mJpeg(size >= 2 && data[0] == 0xFF && data[1] == 0xD8), mReduction(0)
+  {
+    QBuffer buffer(&mData);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer);
+    mSize = reader.size();
+    mNative = mSize.isValid() && reader.supportsOption(QImageIOHandler::ScaledSize) && reader.supportsOption(QImageIOHandler::ClipRect);
+  }
+
+  /**
+   * @returns                          Size of the full-resolution image,
+   *                                   or zero size if it is not known
+   *                                   before decoding.
+   */
+  vigra::Size2D size() const {
+    if(mFull.width() != 0)
+      return mFull.size();
+    return mSize.isValid() ? vigra::Size2D(mSize.width(), mSize.height()) : vigra::Size2D(0, 0);
+  }
+
+  /**
+   * Decodes reduced image. Image is reduced by the largest of 1, 2, 4 and 8
+   * that keeps it at least as large as the given size in one of the
+   * dimensions, so that it can still be resized to fit into that size.
+   *
+   * Reduced image is decoded only once. Pixel (x, y) of the reduced image
+   * covers pixels starting at (x * reduction(), y * reduction()) of the
+   * full-resolution image.
+   *
+   * @param maxSize                    Size the reduced image is to be resized
+   *                                   to fit into.
+   * @returns                          Reduced image.
+   * @throws std::logic_error          If the image could not be decoded.
+   */
+  const vigra::BImage& reduced(const vigra::Size2D& maxSize) {
+    if(mReduction != 0)
+      return mNative ? mReduced : mFull;
+
+    if(!mNative) {
+      decodeFull();
+      mReduction = 1;
+      return mFull;
+    }
+
+    double scale = std::max(static_cast<double>(mSize.width()) / maxSize.width(), static_cast<double>(mSize.height()) / maxSize.height());
+    mReduction = 1;
+    while(mReduction < 8 && mReduction * 2 <= scale)
+      mReduction *= 2;
+
+    if(!read(mReduction, vigra::Rect2D(), mReduced))
+      throw std::logic_error("Could not decode image.");
+    return mReduced;
+  }
+
+  /**
+   * @returns                          Reduction factor of the reduced image,
+   *                                   zero if it was not decoded yet.
+   */
+  int reduction() const {
+    return mReduction;
+  }
+
+  /**
+   * Decodes a region of the image at full resolution.
+   *
+   * @param rect                       Region to decode. Parts of the region
+   *                                   that lie outside the image are
+   *                                   ignored.
+   * @param[out] img                   Decoded region.
+   * @returns                          Region that was actually decoded.
+   * @throws std::logic_error          If the image could not be decoded.
+   */
+  vigra::Rect2D region(const vigra::Rect2D& rect, vigra::BImage& img) {
+    if(!mNative)
+      decodeFull();
+
+    vigra::Rect2D clipped = rect & vigra::Rect2D(vigra::Point2D(0, 0), size());
+    if(clipped.isEmpty()) {
+      img.resize(0, 0);
+      return clipped;
+    }
+
+    /* Small images are not reduced, so the reduced image is already at
+     * full resolution. */
+    const vigra::BImage* full = mNative ? (mReduction == 1 ? &mReduced : NULL) : &mFull;
+    if(full != NULL) {
+      img.resize(clipped.size());
+      copyImage(srcImageRange(*full, clipped), destImage(img));
+      return clipped;
+    }
+
+    if(!read(1, clipped, img))
+      throw std::logic_error("Could not decode image.");
+    return clipped;
+  }
+
+  /**
+   * Decodes the whole image at full resolution.
+   *
+   * @param[out] img                   Decoded image.
+   * @throws std::logic_error          If the image could not be decoded.
+   */
+  void decode(vigra::BImage& img) {
+    if(mFull.width() != 0) {
+      img = mFull;
+      return;
+    }
+
+    if(!read(1, vigra::Rect2D(), img))
+      throw std::logic_error("Could not decode image.");
+  }
+
+private:
+  void decodeFull() {
+    if(mFull.width() == 0)
+      decode(mFull);
+  }
+
+  /**
+   * Decodes the image.
+   *
+   * @param reduction                  Reduction factor, 1, 2, 4 or 8.
+   * @param rect                       Region to decode, in full-resolution
+   *                                   coordinates, empty for the whole image.
+   *                                   Only used without reduction.
+   * @param[out] img                   Decoded image.
+   * @returns                          Whether the image was decoded.
+   */
+  bool read(int reduction, const vigra::Rect2D& rect, vigra::BImage& img) {
+#ifdef BRT_USE_LIBJPEG
+    if(mJpeg && readJpeg(reduction, rect, img))
+      return true;
+#endif
+
+    QBuffer buffer(&mData);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer);
+
+    /* JPEG decoder picks the DCT scale by integer division of the full size
+     * by the requested one, so the requested size is rounded down. The decoder
+     * output is then at most one pixel larger, and Qt resamples it. */
+    QSize size = mSize;
+    if(reduction != 1) {
+      size = QSize(mSize.width() / reduction, mSize.height() / reduction);
+      reader.setScaledSize(size);
+    } else if(!rect.isEmpty()) {
+      size = QSize(rect.width(), rect.height());
+      reader.setClipRect(QRect(rect.left(), rect.top(), rect.width(), rect.height()));
+    }
+    if(!size.isValid())
+      return convert(reader.read(), img);
+
+    /* Decoders that produce 8-bit grayscale images write right into the
+     * wrapped memory if it has the right size. Other images are decoded
+     * into memory of their own and converted. */
+    img.resize(size.width(), size.height());
+    QImage image = wrapImage(img);
+    if(!reader.read(&image))
+      return false;
+    if(image.constBits() == img.data())
+      return true;
+    return convert(image, img);
+  }
+
+#ifdef BRT_USE_LIBJPEG
+  struct JpegErrorManager {
+    jpeg_error_mgr base;
+    std::jmp_buf jump;
+  };
+
+  static void jpegErrorExit(j_common_ptr info) {
+    std::longjmp(reinterpret_cast<JpegErrorManager*>(info->err)->jump, 1);
+  }
+
+  static void jpegOutputMessage(j_common_ptr) {}
+
+  static void jpegInitSource(j_decompress_ptr) {}
+
+  static boolean jpegFillInputBuffer(j_decompress_ptr info) {
+    /* The whole file is already in the buffer, so a truncated file is
+     * terminated with a fake end of image marker, as libjpeg suggests. */
+    static const JOCTET eoi[2] = {0xFF, JPEG_EOI};
+    info->src->next_input_byte = eoi;
+    info->src->bytes_in_buffer = 2;
+    return TRUE;
+  }
+
+  static void jpegSkipInputData(j_decompress_ptr info, long count) {
+    if(count <= 0)
+      return;
+
+    if(static_cast<std::size_t>(count) > info->src->bytes_in_buffer) {
+      jpegFillInputBuffer(info);
+    } else {
+      info->src->next_input_byte += count;
+      info->src->bytes_in_buffer -= count;
+    }
+  }
+
+  static void jpegTermSource(j_decompress_ptr) {}
+
+  /**
+   * Decodes the image with libjpeg into 8-bit luma. Rows below the region
+   * are not decoded at all.
+   *
+   * @returns                          Whether the image was decoded.
+   */
+  bool readJpeg(int reduction, const vigra::Rect2D& rect, vigra::BImage& img) const {
+    /* Only objects with trivial destructors may live in this frame, since
+     * libjpeg errors longjmp out of it. */
+    jpeg_decompress_struct info;
+    JpegErrorManager error;
+    info.err = jpeg_std_error(&error.base);
+    error.base.error_exit = &jpegErrorExit;
+    error.base.output_message = &jpegOutputMessage;
+    if(setjmp(error.jump)) {
+      jpeg_destroy_decompress(&info);
+      return false;
+    }
+    jpeg_create_decompress(&info);
+
+    jpeg_source_mgr source;
+    source.next_input_byte = reinterpret_cast<const JOCTET*>(mData.constData());
+    source.bytes_in_buffer = mData.size();
+    source.init_source = &jpegInitSource;
+    source.fill_input_buffer = &jpegFillInputBuffer;
+    source.skip_input_data = &jpegSkipInputData;
+    source.resync_to_restart = &jpeg_resync_to_restart;
+    source.term_source = &jpegTermSource;
+    info.src = &source;
+
+    jpeg_read_header(&info, TRUE);
+    if(info.jpeg_color_space != JCS_GRAYSCALE && info.jpeg_color_space != JCS_YCbCr) {
+      jpeg_destroy_decompress(&info);
+      return false;
+    }
+    info.out_color_space = JCS_GRAYSCALE;
+    info.scale_num = 1;
+    info.scale_denom = reduction;
+    jpeg_start_decompress(&info);
+
+    vigra::Rect2D whole(0, 0, info.output_width, info.output_height);
+    vigra::Rect2D clipped = rect.isEmpty() ? whole : (rect & whole);
+    img.resize(clipped.size());
+
+    JSAMPARRAY row = (*info.mem->alloc_sarray)(reinterpret_cast<j_common_ptr>(&info), JPOOL_IMAGE, info.output_width, 1);
+    while(info.output_scanline < static_cast<JDIMENSION>(clipped.bottom())) {
+      int y = info.output_scanline;
+      jpeg_read_scanlines(&info, row, 1);
+      if(y >= clipped.top())
+        std::copy(row[0] + clipped.left(), row[0] + clipped.right(), img[y - clipped.top()]);
+    }
+
+    jpeg_destroy_decompress(&info);
+    return true;
+  }
+#endif
+
+  /**
+   * Converts a decoded image to grayscale.
+   *
+   * @returns                          Whether the image is not null.
+   */
+  static bool convert(QImage image, vigra::BImage& img) {
+    if(image.isNull())
+      return false;
+
+    img.resize(image.width(), image.height());
+
+    if(isGray8(image)) {
+      copyImage(srcImageRange(grayView(image)), destImage(img));
+      return true;
+    }
+
+    /* Other 8-bit images are converted through the palette. */
+    if(image.format() == QImage::Format_Indexed8) {
+      QVector<QRgb> colors = image.colorTable();
+      vigra::UInt8 grays[256] = {0};
+      for(int i = 0; i < colors.size() && i < 256; i++)
+        grays[i] = static_cast<vigra::UInt8>(qGray(colors[i]));
+
+      for(int y = 0; y < image.height(); y++) {
+        const uchar* src = image.constScanLine(y);
+        vigra::UInt8* dst = img[y];
+        for(int x = 0; x < image.width(); x++)
+          dst[x] = grays[src[x]];
+      }
+      return true;
+    }
+
+    if(image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32)
+      image = image.convertToFormat(QImage::Format_RGB32);
+    copyImage(srcImageRange(rgb32View(image), QRgbGrayAccessor()), destImage(img));
+    return true;
+  }
+
+  QByteArray mData;
+  bool mJpeg;
+  QSize mSize;
+  bool mNative;
+  int mReduction;
+  vigra::BImage mReduced;
+  vigra::BImage mFull;
+};
+
+#endif // ENCODED_IMAGE_H
@@ -2,12 +2,15 @@
 #define IMAGE_UTILS_H
 
 #include "config.h"
+#include <cassert>
 #include <fstream>
+#include <vector>
 #include <Eigen/Dense>
 #include <vigra/stdimage.hxx>
 #include <vigra/affinegeometry.hxx>
 #include <arx/ext/Vigra.h>
 #include "acv/Keypoint.h"
+#include "barcode/KMeans.h"
 
 template<class PixelType, class Alloc>
 void affineWarpImage(const vigra::BasicImage<PixelType, Alloc>& src, vigra::BasicImage<PixelType, Alloc>& dst, const Eigen::Transform2d& srcToDstTransform) {
@@ -22,8 +25,8 @@ void affineWarpImage(const vigra::BasicImage<PixelType, Alloc>& src, vigra::Basi
   affineWarpImage(vigra::SplineImageView<3, PixelType>(srcImageRange(src)), destImageRange(dst), vigraTransform);
 }
 
-template<class PixelType, class Alloc>
-void warpImage(const vigra::BasicImage<PixelType, Alloc>& src, vigra::BasicImage<PixelType, Alloc>& dst, const Eigen::Transform2d& srcToDstTransform) {
+template<class SrcIterator, class SrcAccessor, class PixelType, class Alloc>
+void warpImage(vigra::triple<SrcIterator, SrcIterator, SrcAccessor> src, vigra::BasicImage<PixelType, Alloc>& dst, const Eigen::Transform2d& srcToDstTransform) {
   /* Important!
    * We are doing some strange manipulations with lu() because fixed-sized matrices
    * use so-called 'optimized' code paths for inverse() method. It seems that in the process
@@ -31,7 +34,7 @@ void warpImage(const vigra::BasicImage<PixelType, Alloc>& src, vigra::BasicImage
   Eigen::Transform2d dstToSrcTransform = Eigen::Transform2d(srcToDstTransform.matrix().lu().inverse());
   assert((srcToDstTransform.matrix() * dstToSrcTransform.matrix()).isIdentity());
 
-  vigra::SplineImageView<3, PixelType> spline(srcImageRange(src));
+  vigra::SplineImageView<3, PixelType> spline(src);
   double y = 0.0f;
   for(int iy = 0; y < dst.height(); iy++, y++) {
     double x = 0.0f;
@@ -43,6 +46,11 @@ void warpImage(const vigra::BasicImage<PixelType, Alloc>& src, vigra::BasicImage
   }
 }
 
+template<class PixelType, class Alloc>
+void warpImage(const vigra::BasicImage<PixelType, Alloc>& src, vigra::BasicImage<PixelType, Alloc>& dst, const Eigen::Transform2d& srcToDstTransform) {
+  warpImage(srcImageRange(src), dst, srcToDstTransform);
+}
+
 template<class PixelType, class Alloc>
 void warpImageNearestNeightbour(const vigra::BasicImage<PixelType, Alloc>& src, vigra::BasicImage<PixelType, Alloc>& dst, const Eigen::Transform2d& srcToDstTransform) {
   /* See important note in warpImage(). */
@@ -84,4 +92,30 @@ void markKeypoints(KeyPointForwardCollection& keyPoints, vigra::BasicImage<Pixel
   }
 }
 
+/**
+ * Performs k-means binarization of an 8-bit image. Cluster centers are
+ * initialized with the darkest and the brightest pixel values, and all
+ * k-means iterations are performed on the image hystogram.
+ *
+ * Pixels of the bright cluster are set to white, other pixels are set to
+ * black. Source and destination images may be the same.
+ */
+template<class Alloc>
+void hystogramKMeansBinarize(const vigra::BasicImage<vigra::UInt8, Alloc>& src, vigra::BasicImage<vigra::UInt8, Alloc>& dst) {
+  assert(src.size() == dst.size());
+
+  std::vector<int> hystogram(256, 0);
+  for(const vigra::UInt8* p = src.begin(); p != src.end(); p++)
+    hystogram[*p]++;
+
+  int a, b;
+  barcode::KMeans::range(hystogram, a, b);
+  barcode::KMeans::centers(hystogram, a, b);
+
+  const int threshold = a + b;
+  const vigra::UInt8* s = src.begin();
+  for(vigra::UInt8* d = dst.begin(); d != dst.end(); d++, s++)
+    *d = 2 * *s > threshold ? 255 : 0;
+}
+
 #endif // IMAGE_UTILS_H
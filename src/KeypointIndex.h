@@ -0,0 +1,402 @@
+#ifndef KEYPOINT_INDEX_H
+#define KEYPOINT_INDEX_H
+
+#include "config.h"
+#include <cassert>
+#include <cstring> /* for std::memcmp() and std::memcpy() */
+#include <string>
+#include <vector>
+#include <functional> /* for std::greater */
+#include <algorithm>
+#include <utility>
+#include <limits>
+#include <ostream>
+#include <stdexcept> /* for std::logic_error */
+#include <boost/noncopyable.hpp>
+#include <QtGlobal>
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include "barcode/Random.h"
+#include "KeypointTemplate.h"
+
+// -------------------------------------------------------------------------- //
+// KeypointIndex
+// -------------------------------------------------------------------------- //
+/**
+ * Randomized k-d forest over the descriptors of a keypoint template, used
+ * for approximate nearest neighbour search.
+ *
+ * Each tree splits the descriptors on one of the dimensions with the
+ * largest variance, picked at random, so that trees partition the space
+ * differently. Search descends all trees at once, always expanding the
+ * closest unexplored branch, and stops after a fixed number of checked
+ * descriptors.
+ *
+ * Index can be saved into a binary file stored alongside the template,
+ * all values are little-endian:
+ *
+ *   Header         magic "BRKI", uint32 version, uint32 keypoint count,
+ *                  uint32 tree count, uint32 node count.
+ *   Roots          uint32 root node for each tree.
+ *   Nodes          int32 split dimension, float split value, uint32 left,
+ *                  uint32 right. Leaves have dimension of -1, and hold
+ *                  the range [left, right) of the keypoint array.
+ *   Keypoints      uint32 keypoint numbers for each tree, in leaf order.
+ */
+class KeypointIndex: public boost::noncopyable {
+public:
+  enum {
+    VERSION = 1,
+    DESCRIPTOR_SIZE = KeypointTemplate::DESCRIPTOR_SIZE
+  };
+
+  struct Header {
+    char magic[4];
+    quint32 version;
+    quint32 count;
+    quint32 treeCount;
+    quint32 nodeCount;
+  };
+
+  struct Node {
+    qint32 dimension;
+    float value;
+    quint32 left;
+    quint32 right;
+  };
+
+  /**
+   * Search buffers, see search(). Searching many descriptors with a single
+   * context doesn't allocate or clear anything proportional to the
+   * template size once the buffers have grown.
+   */
+  class SearchContext {
+  public:
+    SearchContext(): mGeneration(0) {}
+
+  private:
+    friend class KeypointIndex;
+
+    typedef std::pair<float, quint32> Branch;
+
+    std::vector<quint32> mChecked;   /**< Search generation that last checked each keypoint. */
+    quint32 mGeneration;
+    std::vector<Branch> mBranches;   /**< Unexplored branches, a min-heap. */
+  };
+
+  /**
+   * Constructor. Builds index for the given template.
+   *
+   * @param keys                       Keypoint template, must outlive the
+   *                                   index.
+   * @param treeCount                  Number of trees.
+   * @param seed                       Random seed.
+   */
+  KeypointIndex(const KeypointTemplate& keys, int treeCount = KEYPOINT_INDEX_TREES, unsigned seed = 0): mKeys(keys) {
+    assert(treeCount > 0);
+
+    std::vector<quint32> roots(treeCount);
+    std::vector<Node> nodes;
+    std::vector<quint32> indices(static_cast<std::size_t>(treeCount) * keys.size());
+    for(int tree = 0; tree < treeCount; tree++) {
+      quint32* treeIndices = &indices[0] + static_cast<std::size_t>(tree) * keys.size();
+      for(int i = 0; i < keys.size(); i++)
+        treeIndices[i] = i;
+
+      barcode::Random random(seed, tree);
+      roots[tree] = build(treeIndices, static_cast<quint32>(tree) * keys.size(), 0, keys.size(), random, nodes);
+    }
+
+    Header header;
+    std::memcpy(header.magic, "BRKI", 4);
+    header.version = VERSION;
+    header.count = keys.size();
+    header.treeCount = treeCount;
+    header.nodeCount = static_cast<quint32>(nodes.size());
+
+    mBuffer.resize(static_cast<int>(sizeof(Header) + sizeof(quint32) * roots.size() + sizeof(Node) * nodes.size() + sizeof(quint32) * indices.size()));
+    char* data = mBuffer.data();
+    data = append(data, &header, sizeof(Header));
+    data = append(data, &roots[0], sizeof(quint32) * roots.size());
+    data = append(data, nodes.empty() ? NULL : &nodes[0], sizeof(Node) * nodes.size());
+    data = append(data, indices.empty() ? NULL : &indices[0], sizeof(quint32) * indices.size());
+    attach(reinterpret_cast<const uchar*>(mBuffer.constData()), mBuffer.size());
+  }
+
+  /**
+   * Constructor. Loads index for the given template from a file. The file
+   * is memory-mapped if possible.
+   *
+   * @param keys                       Keypoint template the index was built
+   *                                   for, must outlive the index.
+   * @param fileName                   Filename of the index, may be a Qt
+   *                                   resource path.
+   */
+  KeypointIndex(const KeypointTemplate& keys, const std::string& fileName): mKeys(keys), mFile(QString::fromLocal8Bit(fileName.c_str())) {
+    if(!mFile.open(QIODevice::ReadOnly))
+      throw std::logic_error("Could not open keypoint index file \"" + fileName + "\".");
+
+    const uchar* data = mFile.map(0, mFile.size());
+    qint64 size = mFile.size();
+    if(data == NULL || reinterpret_cast<quintptr>(data) % sizeof(quint32) != 0) {
+      if(data != NULL)
+        mFile.unmap(const_cast<uchar*>(data));
+      mBuffer = mFile.readAll();
+      data = reinterpret_cast<const uchar*>(mBuffer.constData());
+      size = mBuffer.size();
+    }
+    attach(data, size);
+  }
+
+  /**
+   * @returns                          Indexed keypoint template.
+   */
+  const KeypointTemplate& keys() const {
+    return mKeys;
+  }
+
+  /**
+   * Finds two approximate nearest neighbours of the given descriptor.
+   *
+   * @param descriptor                 Descriptor to search for.
+   * @param maxChecks                  Maximal number of template
+   *                                   descriptors to compare with.
+   * @param context                    Search buffers.
+   * @param[out] nearest               Number of the nearest keypoint, or -1
+   *                                   if nothing was found.
+   * @param[out] nearestDistance       Squared distance to the nearest
+   *                                   keypoint.
+   * @param[out] secondDistance        Squared distance to the second nearest
+   *                                   keypoint.
+   */
+  void search(const quint8* descriptor, int maxChecks, SearchContext& context, int& nearest, int& nearestDistance, int& secondDistance) const {
+    typedef SearchContext::Branch Branch;
+
+    /* Keypoints checked by previous searches are marked with older
+     * generations, so the marks are only reset when the counter wraps. */
+    std::vector<quint32>& checked = context.mChecked;
+    if(checked.size() != static_cast<std::size_t>(mKeys.size())) {
+      checked.assign(mKeys.size(), 0);
+      context.mGeneration = 0;
+    }
+    if(++context.mGeneration == 0) {
+      std::fill(checked.begin(), checked.end(), 0);
+      context.mGeneration = 1;
+    }
+    quint32 generation = context.mGeneration;
+
+    std::vector<Branch>& branches = context.mBranches;
+    branches.clear();
+
+    nearest = -1;
+    nearestDistance = secondDistance = std::numeric_limits<int>::max();
+    for(quint32 tree = 0; tree < mHeader->treeCount; tree++)
+      branches.push_back(Branch(0.0f, mRoots[tree]));
+    std::make_heap(branches.begin(), branches.end(), std::greater<Branch>());
+
+    int checks = 0;
+    while(!branches.empty() && checks < maxChecks) {
+      std::pop_heap(branches.begin(), branches.end(), std::greater<Branch>());
+      quint32 node = branches.back().second;
+      branches.pop_back();
+
+      /* Descend to a leaf, remembering the branches not taken. */
+      while(mNodes[node].dimension >= 0) {
+        const Node& split = mNodes[node];
+        float diff = descriptor[split.dimension] - split.value;
+        quint32 closer = diff < 0 ? split.left : split.right;
+        quint32 farther = diff < 0 ? split.right : split.left;
+        branches.push_back(Branch(diff * diff, farther));
+        std::push_heap(branches.begin(), branches.end(), std::greater<Branch>());
+        node = closer;
+      }
+
+      const quint32* leafEnd = mIndices + mNodes[node].right;
+      for(const quint32* i = mIndices + mNodes[node].left; i != leafEnd; i++) {
+        if(checked[*i] == generation)
+          continue;
+        checked[*i] = generation;
+        checks++;
+
+        int distance = squaredDistance(descriptor, mKeys[*i].descriptor);
+        if(distance < nearestDistance) {
+          secondDistance = nearestDistance;
+          nearestDistance = distance;
+          nearest = static_cast<int>(*i);
+        } else if(distance < secondDistance) {
+          secondDistance = distance;
+        }
+      }
+    }
+  }
+
+  /**
+   * Writes this index in binary format.
+   *
+   * @param stream                     Stream to write to, must be opened in
+   *                                   binary mode.
+   */
+  void write(std::ostream& stream) const {
+    stream.write(reinterpret_cast<const char*>(mHeader), mSize);
+    if(stream.fail())
+      throw std::logic_error("Could not write keypoint index file.");
+  }
+
+  static int squaredDistance(const quint8* a, const quint8* b) {
+    int result = 0;
+    for(int i = 0; i < DESCRIPTOR_SIZE; i++) {
+      int diff = static_cast<int>(a[i]) - static_cast<int>(b[i]);
+      result += diff * diff;
+    }
+    return result;
+  }
+
+private:
+  static char* append(char* data, const void* src, std::size_t size) {
+    if(size > 0)
+      std::memcpy(data, src, size);
+    return data + size;
+  }
+
+  quint32 build(quint32* indices, quint32 offset, int begin, int end, barcode::Random& random, std::vector<Node>& nodes) const {
+    quint32 result = static_cast<quint32>(nodes.size());
+    nodes.push_back(Node());
+
+    if(end - begin > KEYPOINT_INDEX_LEAF_SIZE) {
+      /* Estimate mean and variance on a subset of descriptors. */
+      const int sampleSize = std::min(end - begin, 128);
+      double mean[DESCRIPTOR_SIZE], variance[DESCRIPTOR_SIZE];
+      std::fill(mean, mean + DESCRIPTOR_SIZE, 0.0);
+      std::fill(variance, variance + DESCRIPTOR_SIZE, 0.0);
+      for(int i = 0; i < sampleSize; i++) {
+        const quint8* descriptor = mKeys[indices[begin + i]].descriptor;
+        for(int d = 0; d < DESCRIPTOR_SIZE; d++) {
+          mean[d] += descriptor[d];
+          variance[d] += descriptor[d] * descriptor[d];
+        }
+      }
+
+      std::vector<std::pair<double, int> > dimensions(DESCRIPTOR_SIZE);
+      for(int d = 0; d < DESCRIPTOR_SIZE; d++) {
+        mean[d] /= sampleSize;
+        dimensions[d] = std::make_pair(variance[d] / sampleSize - mean[d] * mean[d], d);
+      }
+
+      /* Split on one of the top variance dimensions. */
+      std::partial_sort(dimensions.begin(), dimensions.begin() + KEYPOINT_INDEX_SPLIT_CANDIDATES, dimensions.end(), std::greater<std::pair<double, int> >());
+      int dimension = dimensions[random(0, KEYPOINT_INDEX_SPLIT_CANDIDATES)].second;
+      float value = static_cast<float>(mean[dimension]);
+
+      quint32* middle = std::partition(indices + begin, indices + end, LessThan(mKeys, dimension, value));
+      if(middle == indices + begin || middle == indices + end) {
+        /* Mean split is degenerate, split at the median. */
+        middle = indices + (begin + end) / 2;
+        std::nth_element(indices + begin, middle, indices + end, DimensionLess(mKeys, dimension));
+        value = mKeys[*middle].descriptor[dimension];
+        middle = std::partition(indices + begin, indices + end, LessThan(mKeys, dimension, value));
+        if(middle == indices + begin) {
+          value += 0.5f;
+          middle = std::partition(indices + begin, indices + end, LessThan(mKeys, dimension, value));
+        }
+      }
+
+      if(middle != indices + begin && middle != indices + end) {
+        int split = static_cast<int>(middle - indices);
+        quint32 left = build(indices, offset, begin, split, random, nodes);
+        quint32 right = build(indices, offset, split, end, random, nodes);
+
+        Node& node = nodes[result];
+        node.dimension = dimension;
+        node.value = value;
+        node.left = left;
+        node.right = right;
+        return result;
+      }
+    }
+
+    /* Leaf node. Keypoint ranges are stored relative to the whole array. */
+    Node& node = nodes[result];
+    node.dimension = -1;
+    node.value = 0.0f;
+    node.left = offset + begin;
+    node.right = offset + end;
+    return result;
+  }
+
+  void attach(const uchar* data, qint64 size) {
+#if Q_BYTE_ORDER != Q_LITTLE_ENDIAN
+    throw std::logic_error("Binary keypoint index files are not supported on big-endian platforms.");
+#endif
+    const Header* header = reinterpret_cast<const Header*>(data);
+    if(size < static_cast<qint64>(sizeof(Header)) || std::memcmp(header->magic, "BRKI", 4) != 0 || header->version != VERSION || header->treeCount == 0)
+      throw std::logic_error("Invalid keypoint index file format.");
+    if(header->count != static_cast<quint32>(mKeys.size()))
+      throw std::logic_error("Keypoint index file does not match the keypoint file.");
+
+    qint64 expectedSize = sizeof(Header) + sizeof(quint32) * static_cast<qint64>(header->treeCount) + sizeof(Node) * static_cast<qint64>(header->nodeCount) + sizeof(quint32) * static_cast<qint64>(header->treeCount) * header->count;
+    if(size < expectedSize)
+      throw std::logic_error("Invalid keypoint index file format.");
+
+    mHeader = header;
+    mRoots = reinterpret_cast<const quint32*>(data + sizeof(Header));
+    mNodes = reinterpret_cast<const Node*>(mRoots + header->treeCount);
+    mIndices = reinterpret_cast<const quint32*>(mNodes + header->nodeCount);
+    mSize = static_cast<std::streamsize>(expectedSize);
+
+    /* Validate the tree structure, so that search never leaves the file. */
+    quint32 indexCount = header->treeCount * header->count;
+    for(quint32 i = 0; i < header->treeCount; i++)
+      if(mRoots[i] >= header->nodeCount)
+        throw std::logic_error("Invalid keypoint index file format.");
+    for(quint32 i = 0; i < header->nodeCount; i++) {
+      const Node& node = mNodes[i];
+      bool valid = node.dimension < 0 ?
+        node.left <= node.right && node.right <= indexCount :
+        node.dimension < DESCRIPTOR_SIZE && node.left > i && node.right > i && node.left < header->nodeCount && node.right < header->nodeCount;
+      if(!valid)
+        throw std::logic_error("Invalid keypoint index file format.");
+    }
+    for(quint32 i = 0; i < indexCount; i++)
+      if(mIndices[i] >= header->count)
+        throw std::logic_error("Invalid keypoint index file format.");
+  }
+
+  class LessThan {
+  public:
+    LessThan(const KeypointTemplate& keys, int dimension, float value): mKeys(keys), mDimension(dimension), mValue(value) {}
+
+    bool operator()(quint32 index) const {
+      return mKeys[index].descriptor[mDimension] < mValue;
+    }
+
+  private:
+    const KeypointTemplate& mKeys;
+    int mDimension;
+    float mValue;
+  };
+
+  class DimensionLess {
+  public:
+    DimensionLess(const KeypointTemplate& keys, int dimension): mKeys(keys), mDimension(dimension) {}
+
+    bool operator()(quint32 a, quint32 b) const {
+      return mKeys[a].descriptor[mDimension] < mKeys[b].descriptor[mDimension];
+    }
+
+  private:
+    const KeypointTemplate& mKeys;
+    int mDimension;
+  };
+
+  const KeypointTemplate& mKeys;
+  QFile mFile;
+  QByteArray mBuffer;
+  const Header* mHeader;
+  const quint32* mRoots;
+  const Node* mNodes;
+  const quint32* mIndices;
+  std::streamsize mSize;
+};
+
+#endif // KEYPOINT_INDEX_H
@@ -0,0 +1,216 @@
+#ifndef KEYPOINT_MATCHER_H
+#define KEYPOINT_MATCHER_H
+
+#include "config.h"
+#include <cmath>
+#include <complex>
+#include <algorithm> /* for std::max() */
+#include <vector>
+#include <utility>
+#include "barcode/Random.h"
+#include "KeypointTemplate.h"
+#include "KeypointIndex.h"
+
+// -------------------------------------------------------------------------- //
+// KeypointMatcher
+// -------------------------------------------------------------------------- //
+/**
+ * Matches image keypoints against an indexed keypoint template and
+ * estimates the similarity (rotation, scale and translation) transformation
+ * from image coordinates to template coordinates.
+ *
+ * Candidate matches are found with the template descriptor index and
+ * filtered with the distance ratio test. The transformation is then
+ * estimated with RANSAC on pairs of matches, and refined with least squares
+ * on all inliers.
+ *
+ * Points are represented as complex numbers, so that a similarity
+ * transformation is z -> a * z + b.
+ */
+class KeypointMatcher {
+public:
+  typedef std::complex<double> Point;
+  typedef std::pair<Point, Point> PointMatch; /**< Image point and template point. */
+
+  /**
+   * Constructor.
+   *
+   * @param index                      Template descriptor index.
+   * @param maxError                   Maximal reprojection error for an
+   *                                   inlier, relative to the template size.
+   * @param iterations                 Number of RANSAC iterations.
+   * @param maxChecks                  Maximal number of template descriptors
+   *                                   compared with a single image
+   *                                   descriptor.
+   */
+  KeypointMatcher(const KeypointIndex& index, double maxError, int iterations = SIMILARITY_RANSAC_ITERATIONS, int maxChecks = KEYPOINT_INDEX_CHECKS):
+    mIndex(index), mIterations(iterations), mMaxChecks(maxChecks), mA(1.0), mB(0.0), mInliers(0), mError(0.0)
+  {
+    double size = std::max(index.keys().width(), index.keys().height());
+    mMaxSquaredError = (maxError * size) * (maxError * size);
+  }
+
+  /**
+   * Matches the given image keypoints.
+   *
+   * @param image                      Image keypoints.
+   * @param refine                     Whether to refine the transformation
+   *                                   with least squares on all inliers.
+   * @returns                          Whether at least MIN_MATCHES inliers
+   *                                   were found.
+   */
+  bool operator()(const KeypointTemplate& image, bool refine) {
+    /* Find candidate matches. */
+    const KeypointTemplate& keys = mIndex.keys();
+    std::vector<PointMatch> matches;
+    KeypointIndex::SearchContext context;
+    for(int i = 0; i < image.size(); i++) {
+      int nearest, nearestDistance, secondDistance;
+      mIndex.search(image[i].descriptor, mMaxChecks, context, nearest, nearestDistance, secondDistance);
+      if(nearest >= 0 && nearestDistance < MAX_MATCH_DISTANCE_RATIO * MAX_MATCH_DISTANCE_RATIO * static_cast<double>(secondDistance))
+        matches.push_back(PointMatch(Point(image[i].x, image[i].y), Point(keys[nearest].x, keys[nearest].y)));
+    }
+
+    mInliers = 0;
+    mError = 0.0;
+    if(static_cast<int>(matches.size()) < MIN_MATCHES)
+      return false;
+
+    /* Estimate transformation from random pairs of matches. */
+    barcode::Random random(0, 0);
+    for(int iteration = 0; iteration < mIterations; iteration++) {
+      const PointMatch& m0 = matches[random(0, static_cast<int>(matches.size()))];
+      const PointMatch& m1 = matches[random(0, static_cast<int>(matches.size()))];
+      Point imageDelta = m1.first - m0.first;
+      if(std::norm(imageDelta) < 1.0)
+        continue;
+
+      Point a = (m1.second - m0.second) / imageDelta;
+      Point b = m0.second - a * m0.first;
+      int inliers = countInliers(matches, a, b, NULL);
+      if(inliers > mInliers) {
+        mInliers = inliers;
+        mA = a;
+        mB = b;
+      }
+    }
+
+    /* Refine. Least squares fit is exact for a similarity, so a couple of
+     * refitting rounds on the updated inlier set are enough. */
+    if(refine) {
+      for(int round = 0; round < 2 && mInliers >= 2; round++) {
+        std::vector<PointMatch> inliers;
+        countInliers(matches, mA, mB, &inliers);
+
+        Point a, b;
+        if(!fit(inliers, a, b))
+          break;
+        int count = countInliers(matches, a, b, NULL);
+        if(count < mInliers)
+          break;
+        mInliers = count;
+        mA = a;
+        mB = b;
+      }
+    }
+
+    /* Root mean square error of the inliers. */
+    std::vector<PointMatch> inliers;
+    countInliers(matches, mA, mB, &inliers);
+    double squaredError = 0.0;
+    for(std::size_t i = 0; i < inliers.size(); i++)
+      squaredError += std::norm(mA * inliers[i].first + mB - inliers[i].second);
+    mError = inliers.empty() ? 0.0 : std::sqrt(squaredError / inliers.size());
+
+    return mInliers >= MIN_MATCHES;
+  }
+
+  /**
+   * @returns                          Number of inliers of the estimated
+   *                                   transformation.
+   */
+  int inliers() const {
+    return mInliers;
+  }
+
+  /**
+   * @returns                          Root mean square reprojection error of
+   *                                   the inliers, in template pixels.
+   */
+  double error() const {
+    return mError;
+  }
+
+  /**
+   * @returns                          Linear part of the estimated
+   *                                   transformation, z -> a * z + b.
+   */
+  Point a() const {
+    return mA;
+  }
+
+  /**
+   * @returns                          Translation part of the estimated
+   *                                   transformation, z -> a * z + b.
+   */
+  Point b() const {
+    return mB;
+  }
+
+  /**
+   * Fits a similarity transformation to the given matches with least
+   * squares.
+   *
+   * @param matches                    Image points and template points.
+   * @param[out] a                     Linear part of the transformation.
+   * @param[out] b                     Translation part of the transformation.
+   * @returns                          Whether the image points are not all
+   *                                   the same, so that the fit is defined.
+   */
+  static bool fit(const std::vector<PointMatch>& matches, Point& a, Point& b) {
+    Point imageMean, keysMean;
+    for(std::size_t i = 0; i < matches.size(); i++) {
+      imageMean += matches[i].first;
+      keysMean += matches[i].second;
+    }
+    imageMean /= static_cast<double>(matches.size());
+    keysMean /= static_cast<double>(matches.size());
+
+    Point covariance;
+    double variance = 0.0;
+    for(std::size_t i = 0; i < matches.size(); i++) {
+      Point imageDelta = matches[i].first - imageMean;
+      covariance += (matches[i].second - keysMean) * std::conj(imageDelta);
+      variance += std::norm(imageDelta);
+    }
+    if(variance < 1.0)
+      return false;
+
+    a = covariance / variance;
+    b = keysMean - a * imageMean;
+    return true;
+  }
+
+private:
+  int countInliers(const std::vector<PointMatch>& matches, Point a, Point b, std::vector<PointMatch>* inliers) const {
+    int result = 0;
+    for(std::size_t i = 0; i < matches.size(); i++) {
+      if(std::norm(a * matches[i].first + b - matches[i].second) < mMaxSquaredError) {
+        result++;
+        if(inliers != NULL)
+          inliers->push_back(matches[i]);
+      }
+    }
+    return result;
+  }
+
+  const KeypointIndex& mIndex;
+  int mIterations;
+  int mMaxChecks;
+  double mMaxSquaredError;
+  Point mA, mB;
+  int mInliers;
+  double mError;
+};
+
+#endif // KEYPOINT_MATCHER_H
@@ -0,0 +1,254 @@
+#ifndef KEYPOINT_TEMPLATE_H
+#define KEYPOINT_TEMPLATE_H
+
+#include "config.h"
+#include <cassert>
+#include <cstring> /* for std::memcmp() and std::memcpy() */
+#include <algorithm> /* for std::min() and std::max() */
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <iterator> /* for std::istreambuf_iterator */
+#include <stdexcept> /* for std::logic_error */
+#include <boost/noncopyable.hpp>
+#include <QtGlobal>
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+// -------------------------------------------------------------------------- //
+// KeypointTemplate
+// -------------------------------------------------------------------------- //
+/**
+ * Keypoint template, i.e. keypoints extracted from a reference image, stored
+ * in a compact binary format that is used right from the mapped file.
+ *
+ * Binary file is a header followed by an array of fixed-size keypoint
+ * records, all values are little-endian:
+ *
+ *   Header         magic "BRKT", uint32 version, uint32 image width,
+ *                  uint32 image height, uint32 keypoint count,
+ *                  uint32 descriptor size.
+ *   Record         float x, float y, float angle, float scale,
+ *                  uint8 descriptor[descriptor size].
+ *
+ * Text keypoint files written by acv are converted into the same layout in
+ * memory when loaded.
+ */
+class KeypointTemplate: public boost::noncopyable {
+public:
+  enum {
+    VERSION = 1,
+    DESCRIPTOR_SIZE = 128
+  };
+
+  struct Header {
+    char magic[4];
+    quint32 version;
+    quint32 width;
+    quint32 height;
+    quint32 count;
+    quint32 descriptorSize;
+  };
+
+  struct Record {
+    float x;
+    float y;
+    float angle;
+    float scale;
+    quint8 descriptor[DESCRIPTOR_SIZE];
+  };
+
+  /**
+   * Constructor. Loads keypoint template from a file in either binary or
+   * text format. Binary files are memory-mapped if possible.
+   *
+   * @param fileName                   Filename of the template, may be a
+   *                                   Qt resource path.
+   */
+  explicit KeypointTemplate(const std::string& fileName): mFile(QString::fromLocal8Bit(fileName.c_str())), mHeader(NULL), mRecords(NULL) {
+    if(!mFile.open(QIODevice::ReadOnly))
+      throw std::logic_error("Could not open keypoint file \"" + fileName + "\".");
+
+    const uchar* data = mFile.map(0, mFile.size());
+    qint64 size = mFile.size();
+    if(data == NULL || !isBinary(data, size) || reinterpret_cast<quintptr>(data) % sizeof(float) != 0) {
+      if(data != NULL)
+        mFile.unmap(const_cast<uchar*>(data));
+      mBuffer = mFile.readAll();
+      data = reinterpret_cast<const uchar*>(mBuffer.constData());
+      size = mBuffer.size();
+    }
+
+    if(isBinary(data, size)) {
+      attach(data, size);
+    } else {
+      std::string text(reinterpret_cast<const char*>(data), static_cast<std::size_t>(size));
+      mFile.close();
+      mBuffer.clear();
+      parse(text);
+    }
+  }
+
+  /**
+   * Constructor. Parses keypoint template in text format.
+   *
+   * @param stream                     Stream to read the template from.
+   */
+  explicit KeypointTemplate(std::istream& stream): mHeader(NULL), mRecords(NULL) {
+    std::string text((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    parse(text);
+  }
+
+  /**
+   * Constructor. Copies the given keypoints, e.g. keypoints of an
+   * acv::Extract, without going through the text format.
+   *
+   * @param width                      Width of the reference image.
+   * @param height                     Height of the reference image.
+   * @param keypoints                  Collection of keypoint pointers that
+   *                                   provide x(), y(), angle(), scale()
+   *                                   and a descriptor() of DESCRIPTOR_SIZE
+   *                                   values in [0, 255].
+   */
+  template<class KeypointCollection>
+  KeypointTemplate(int width, int height, const KeypointCollection& keypoints): mHeader(NULL), mRecords(NULL) {
+    assert(width >= 0 && height >= 0);
+
+    Record* record = allocate(width, height, static_cast<int>(keypoints.size()));
+    for(typename KeypointCollection::const_iterator i = keypoints.begin(); i != keypoints.end(); ++i, ++record) {
+      record->x = (*i)->x();
+      record->y = (*i)->y();
+      record->angle = (*i)->angle();
+      record->scale = (*i)->scale();
+      for(int j = 0; j < DESCRIPTOR_SIZE; j++)
+        record->descriptor[j] = static_cast<quint8>(std::min(255, std::max(0, static_cast<int>((*i)->descriptor()[j]))));
+    }
+  }
+
+  /**
+   * @returns                          Whether the given data starts with
+   *                                   a binary template header.
+   */
+  static bool isBinary(const uchar* data, qint64 size) {
+    return size >= static_cast<qint64>(sizeof(Header)) && std::memcmp(data, "BRKT", 4) == 0;
+  }
+
+  /**
+   * @returns                          Width of the reference image.
+   */
+  int width() const {
+    return static_cast<int>(mHeader->width);
+  }
+
+  /**
+   * @returns                          Height of the reference image.
+   */
+  int height() const {
+    return static_cast<int>(mHeader->height);
+  }
+
+  /**
+   * @returns                          Number of keypoints.
+   */
+  int size() const {
+    return static_cast<int>(mHeader->count);
+  }
+
+  const Record& operator[](int index) const {
+    assert(index >= 0 && index < size());
+
+    return mRecords[index];
+  }
+
+  /**
+   * Writes this template in acv text format, readable with operator>> of
+   * acv::Extract.
+   *
+   * @param stream                     Stream to write to.
+   */
+  void writeText(std::ostream& stream) const {
+    stream << "ARXKPF2 " << width() << " " << height() << " " << size() << std::endl;
+    stream << std::setprecision(9);
+    for(int i = 0; i < size(); i++) {
+      const Record& record = mRecords[i];
+      stream << "KPV1 " << record.x << " " << record.y << " " << record.angle << " " << record.scale;
+      for(int j = 0; j < DESCRIPTOR_SIZE; j++)
+        stream << " " << static_cast<int>(record.descriptor[j]);
+      stream << std::endl;
+    }
+  }
+
+  /**
+   * Writes this template in binary format.
+   *
+   * @param stream                     Stream to write to, must be opened in
+   *                                   binary mode.
+   */
+  void writeBinary(std::ostream& stream) const {
+    stream.write(reinterpret_cast<const char*>(mHeader), sizeof(Header));
+    stream.write(reinterpret_cast<const char*>(mRecords), static_cast<std::streamsize>(sizeof(Record)) * size());
+    if(stream.fail())
+      throw std::logic_error("Could not write keypoint file.");
+  }
+
+private:
+  void attach(const uchar* data, qint64 size) {
+#if Q_BYTE_ORDER != Q_LITTLE_ENDIAN
+    throw std::logic_error("Binary keypoint files are not supported on big-endian platforms.");
+#endif
+    const Header* header = reinterpret_cast<const Header*>(data);
+    if(header->version != VERSION || header->descriptorSize != DESCRIPTOR_SIZE || size < static_cast<qint64>(sizeof(Header)) + static_cast<qint64>(sizeof(Record)) * header->count)
+      throw std::logic_error("Invalid keypoint file format.");
+
+    mHeader = header;
+    mRecords = reinterpret_cast<const Record*>(data + sizeof(Header));
+  }
+
+  void parse(const std::string& text) {
+    std::istringstream stream(text);
+    std::string tag;
+    int width, height, count;
+    stream >> tag >> width >> height >> count;
+    if(stream.fail() || tag != "ARXKPF2" || width < 0 || height < 0 || count < 0 || count > static_cast<int>(text.size() / (2 * DESCRIPTOR_SIZE)))
+      throw std::logic_error("Invalid keypoint file format.");
+
+    Record* records = allocate(width, height, count);
+    for(int i = 0; i < count; i++) {
+      Record& record = records[i];
+      stream >> tag >> record.x >> record.y >> record.angle >> record.scale;
+      for(int j = 0; j < DESCRIPTOR_SIZE; j++) {
+        int value = -1;
+        stream >> value;
+        if(value < 0 || value > 255)
+          throw std::logic_error("Invalid keypoint file format.");
+        record.descriptor[j] = static_cast<quint8>(value);
+      }
+      if(stream.fail() || tag != "KPV1")
+        throw std::logic_error("Invalid keypoint file format.");
+    }
+  }
+
+  Record* allocate(int width, int height, int count) {
+    mBuffer.resize(static_cast<int>(sizeof(Header) + sizeof(Record) * count));
+    Header* header = reinterpret_cast<Header*>(mBuffer.data());
+    std::memcpy(header->magic, "BRKT", 4);
+    header->version = VERSION;
+    header->width = width;
+    header->height = height;
+    header->count = count;
+    header->descriptorSize = DESCRIPTOR_SIZE;
+
+    Record* records = reinterpret_cast<Record*>(mBuffer.data() + sizeof(Header));
+    mHeader = header;
+    mRecords = records;
+    return records;
+  }
+
+  QFile mFile;
+  QByteArray mBuffer;
+  const Header* mHeader;
+  const Record* mRecords;
+};
+
+#endif // KEYPOINT_TEMPLATE_H
@@ -0,0 +1,265 @@
+#ifndef MAPPED_IMAGE_H
+#define MAPPED_IMAGE_H
+
+#include "config.h"
+#include <cassert>
+#include <algorithm> /* for std::copy() */
+#include <cctype>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <QFile>
+#include <QString>
+#include <vigra/stdimage.hxx>
+#include <vigra/imageiterator.hxx>
+#include <vigra/rgbvalue.hxx>
+
+// -------------------------------------------------------------------------- //
+// MappedImage
+// -------------------------------------------------------------------------- //
+/**
+ * Uncompressed image file mapped into memory, so that regions of it can be
+ * copied into vigra images without decoding or reading the whole file.
+ * Grayscale images can also be viewed in place, as a read-only vigra image.
+ *
+ * Supported files are uncompressed 8-bit grayscale and 24-bit BMP files,
+ * and binary 8-bit PGM files. Pixels are read from the file as they are
+ * accessed, so reading a region of the image only touches the pages that
+ * hold its rows. Other files are not mapped, and have to be loaded the
+ * usual way.
+ *
+ * Rows of BMP files are usually stored bottom-up, such images are read
+ * and viewed with a negative row stride.
+ */
+class MappedImage: public boost::noncopyable {
+public:
+  enum Format {
+    NO_FORMAT,    /**< File is not mapped. */
+    GRAY8,        /**< 8-bit grayscale. */
+    BGR24         /**< 24-bit color, blue component first. */
+  };
+
+  enum {
+    MAX_SIZE = 1 << 16  /**< Maximal width and height of a mapped image. */
+  };
+
+  typedef vigra::ConstImageIterator<vigra::UInt8> GrayIterator;
+
+  /**
+   * Constructor. Maps the given file if it is supported.
+   *
+   * @param fileName                   Filename of the image.
+   */
+  explicit MappedImage(const std::string& fileName): mFile(QString::fromLocal8Bit(fileName.c_str())), mFormat(NO_FORMAT), mData(NULL), mWidth(0), mHeight(0), mStride(0) {
+    if(!mFile.open(QIODevice::ReadOnly))
+      return;
+
+    qint64 size = mFile.size();
+    const uchar* data = mFile.map(0, size);
+    if(data == NULL)
+      return;
+
+    if(!parseBmp(data, size) && !parsePgm(data, size)) {
+      mFile.unmap(const_cast<uchar*>(data));
+      mFormat = NO_FORMAT;
+    }
+  }
+
+  /**
+   * @returns                          Whether the file is mapped.
+   */
+  bool isMapped() const {
+    return mFormat != NO_FORMAT;
+  }
+
+  Format format() const {
+    return mFormat;
+  }
+
+  vigra::Size2D size() const {
+    return vigra::Size2D(mWidth, mHeight);
+  }
+
+  /**
+   * @returns                          Iterator pointing to the upper left
+   *                                   pixel of a GRAY8 image. Pixels are
+   *                                   read right from the mapped file.
+   */
+  GrayIterator grayUpperLeft() const {
+    assert(mFormat == GRAY8);
+
+    return GrayIterator(mData, mStride);
+  }
+
+  /**
+   * @returns                          Iterator pointing past the lower right
+   *                                   pixel of a GRAY8 image.
+   */
+  GrayIterator grayLowerRight() const {
+    return grayUpperLeft() + size();
+  }
+
+  /**
+   * Copies a region of the image into a grayscale image. Only the rows of
+   * the region are read from the file.
+   *
+   * @param rect                       Region to copy, must lie inside the
+   *                                   image.
+   * @param[out] img                   Copied region.
+   */
+  void region(const vigra::Rect2D& rect, vigra::BImage& img) const {
+    assert(isMapped() && vigra::Rect2D(vigra::Point2D(0, 0), size()).contains(rect));
+
+    img.resize(rect.size());
+    for(int y = 0; y < rect.height(); y++) {
+      const uchar* src = scanLine(rect.top() + y);
+      vigra::UInt8* dst = img[y];
+      if(mFormat == GRAY8) {
+        std::copy(src + rect.left(), src + rect.right(), dst);
+      } else {
+        const uchar* p = src + 3 * rect.left();
+        for(int x = 0; x < rect.width(); x++, p += 3)
+          dst[x] = static_cast<vigra::UInt8>((p[0] * 5 + p[1] * 16 + p[2] * 11) / 32); /* Same as qGray(). */
+      }
+    }
+  }
+
+  /**
+   * Copies a region of the image into a color image. Only the rows of the
+   * region are read from the file.
+   *
+   * @param rect                       Region to copy, must lie inside the
+   *                                   image.
+   * @param[out] img                   Copied region.
+   */
+  void region(const vigra::Rect2D& rect, vigra::BRGBImage& img) const {
+    assert(isMapped() && vigra::Rect2D(vigra::Point2D(0, 0), size()).contains(rect));
+
+    img.resize(rect.size());
+    for(int y = 0; y < rect.height(); y++) {
+      const uchar* src = scanLine(rect.top() + y);
+      vigra::RGBValue<vigra::UInt8>* dst = img[y];
+      if(mFormat == GRAY8) {
+        for(int x = 0; x < rect.width(); x++)
+          dst[x] = vigra::RGBValue<vigra::UInt8>(src[rect.left() + x], src[rect.left() + x], src[rect.left() + x]);
+      } else {
+        const uchar* p = src + 3 * rect.left();
+        for(int x = 0; x < rect.width(); x++, p += 3)
+          dst[x] = vigra::RGBValue<vigra::UInt8>(p[2], p[1], p[0]);
+      }
+    }
+  }
+
+private:
+  const uchar* scanLine(int y) const {
+    return mData + static_cast<std::ptrdiff_t>(y) * mStride;
+  }
+
+  static unsigned readU16(const uchar* p) {
+    return p[0] | (p[1] << 8);
+  }
+
+  static unsigned readU32(const uchar* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<unsigned>(p[3]) << 24);
+  }
+
+  static qint64 readS32(const uchar* p) {
+    qint64 value = readU32(p);
+    return value >= (Q_INT64_C(1) << 31) ? value - (Q_INT64_C(1) << 32) : value;
+  }
+
+  bool parseBmp(const uchar* data, qint64 size) {
+    if(size < 54 || data[0] != 'B' || data[1] != 'M')
+      return false;
+
+    unsigned offset = readU32(data + 10);
+    unsigned infoSize = readU32(data + 14);
+    qint64 width = readS32(data + 18);
+    qint64 height = readS32(data + 22);
+    unsigned bitCount = readU16(data + 28);
+    unsigned compression = readU32(data + 30);
+    unsigned colorsUsed = readU32(data + 46);
+    if(infoSize < 40 || 14 + static_cast<qint64>(infoSize) > size || readU16(data + 26) != 1 || compression != 0 || width <= 0 || width > MAX_SIZE || height == 0 || height < -MAX_SIZE || height > MAX_SIZE)
+      return false;
+
+    if(bitCount == 8) {
+      /* Only grayscale palettes are viewed as is. */
+      unsigned colorCount = colorsUsed != 0 ? colorsUsed : 256;
+      const uchar* palette = data + 14 + infoSize;
+      if(colorCount > 256 || palette + 4 * colorCount > data + size)
+        return false;
+      for(unsigned i = 0; i < colorCount; i++)
+        if(palette[4 * i] != i || palette[4 * i + 1] != i || palette[4 * i + 2] != i)
+          return false;
+      mFormat = GRAY8;
+    } else if(bitCount == 24) {
+      mFormat = BGR24;
+    } else {
+      return false;
+    }
+
+    /* Sizes are bounded, so neither the stride nor the data size overflow. */
+    qint64 stride = (width * bitCount + 31) / 32 * 4;
+    qint64 rows = height > 0 ? height : -height;
+    if(offset + stride * rows > size) {
+      mFormat = NO_FORMAT;
+      return false;
+    }
+
+    mWidth = static_cast<int>(width);
+    mHeight = static_cast<int>(rows);
+    if(height > 0) {
+      mData = data + offset + static_cast<std::ptrdiff_t>(rows - 1) * stride;
+      mStride = -static_cast<int>(stride);
+    } else {
+      mData = data + offset;
+      mStride = static_cast<int>(stride);
+    }
+    return true;
+  }
+
+  bool parsePgm(const uchar* data, qint64 size) {
+    if(size < 2 || data[0] != 'P' || data[1] != '5')
+      return false;
+
+    /* Header is width, height and maximal value, separated by whitespace
+     * and comments, and followed by a single whitespace character. */
+    qint64 pos = 2;
+    int values[3];
+    for(int i = 0; i < 3; i++) {
+      while(pos < size && (std::isspace(data[pos]) || data[pos] == '#')) {
+        if(data[pos] == '#')
+          while(pos < size && data[pos] != '\n')
+            pos++;
+        else
+          pos++;
+      }
+      if(pos >= size || !std::isdigit(data[pos]))
+        return false;
+
+      values[i] = 0;
+      while(pos < size && std::isdigit(data[pos]) && values[i] <= MAX_SIZE)
+        values[i] = values[i] * 10 + (data[pos++] - '0');
+    }
+    if(pos >= size || !std::isspace(data[pos]) || values[0] <= 0 || values[0] > MAX_SIZE || values[1] <= 0 || values[1] > MAX_SIZE || values[2] != 255)
+      return false;
+    pos++;
+
+    if(pos + static_cast<qint64>(values[0]) * values[1] > size)
+      return false;
+
+    mFormat = GRAY8;
+    mData = data + pos;
+    mWidth = values[0];
+    mHeight = values[1];
+    mStride = values[0];
+    return true;
+  }
+
+  QFile mFile;
+  Format mFormat;
+  const uchar* mData;
+  int mWidth, mHeight;
+  int mStride;
+};
+
+#endif // MAPPED_IMAGE_H
@@ -0,0 +1,153 @@
+#ifndef QIMAGE_VIEWS_H
+#define QIMAGE_VIEWS_H
+
+#include "config.h"
+#include <cassert>
+#include <string>
+#include <stdexcept> /* for std::logic_error */
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <vigra/stdimage.hxx>
+#include <vigra/basicimageview.hxx>
+
+/**
+ * Accessor that reads 32-bit QImage pixels as vigra RGB values.
+ */
+class QRgbAccessor {
+public:
+  typedef vigra::RGBValue<vigra::UInt8> value_type;
+
+  template<class Iterator>
+  value_type operator()(const Iterator& i) const {
+    return value_type(qRed(*i), qGreen(*i), qBlue(*i));
+  }
+
+  template<class Iterator, class Difference>
+  value_type operator()(const Iterator& i, const Difference& d) const {
+    return value_type(qRed(i[d]), qGreen(i[d]), qBlue(i[d]));
+  }
+};
+
+/**
+ * Accessor that reads 32-bit QImage pixels as gray values, see qGray().
+ */
+class QRgbGrayAccessor {
+public:
+  typedef vigra::UInt8 value_type;
+
+  template<class Iterator>
+  value_type operator()(const Iterator& i) const {
+    return static_cast<value_type>(qGray(*i));
+  }
+
+  template<class Iterator, class Difference>
+  value_type operator()(const Iterator& i, const Difference& d) const {
+    return static_cast<value_type>(qGray(i[d]));
+  }
+};
+
+/**
+ * @returns                            Color table that maps 8-bit indices
+ *                                     to the same gray levels.
+ */
+inline QVector<QRgb> grayColorTable() {
+  QVector<QRgb> colors(256);
+  for(int i = 0; i < 256; i++)
+    colors[i] = qRgb(i, i, i);
+  return colors;
+}
+
+/**
+ * @returns                            Whether the given image is 8-bit
+ *                                     grayscale, i.e. an indexed image with
+ *                                     the color table of grayColorTable().
+ */
+inline bool isGray8(const QImage& image) {
+  if(image.format() != QImage::Format_Indexed8 || image.colorCount() != 256)
+    return false;
+
+  for(int i = 0; i < 256; i++)
+    if(image.color(i) != qRgb(i, i, i))
+      return false;
+  return true;
+}
+
+/**
+ * Views the pixels of an 8-bit grayscale QImage as a vigra image, without
+ * copying. View is valid as long as the image is not modified or destroyed.
+ *
+ * @param image                        Image, see isGray8().
+ * @returns                            View of the image pixels.
+ */
+inline vigra::BasicImageView<vigra::UInt8> grayView(const QImage& image) {
+  assert(isGray8(image));
+
+  return vigra::BasicImageView<vigra::UInt8>(const_cast<vigra::UInt8*>(image.constBits()), image.width(), image.height(), image.bytesPerLine());
+}
+
+/**
+ * Views the pixels of a 32-bit QImage as a vigra image, without copying.
+ * Pixels can be read with QRgbAccessor or QRgbGrayAccessor. View is valid
+ * as long as the image is not modified or destroyed.
+ *
+ * @param image                        Image in Format_RGB32 or
+ *                                     Format_ARGB32.
+ * @returns                            View of the image pixels.
+ */
+inline vigra::BasicImageView<QRgb> rgb32View(const QImage& image) {
+  assert(image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32);
+
+  return vigra::BasicImageView<QRgb>(reinterpret_cast<QRgb*>(const_cast<uchar*>(image.constBits())), image.width(), image.height(), image.bytesPerLine() / sizeof(QRgb));
+}
+
+/**
+ * Wraps the pixels of a vigra image into an 8-bit grayscale QImage, without
+ * copying. QImage is valid as long as the vigra image is not resized or
+ * destroyed.
+ *
+ * Wrapped image can be passed to QImageReader::read(), which decodes
+ * grayscale images of the same size right into the vigra image memory.
+ *
+ * @param img                          Image to wrap.
+ * @returns                            QImage that shares pixels with the
+ *                                     given image.
+ */
+inline QImage wrapImage(vigra::BImage& img) {
+  QImage result(img.data(), img.width(), img.height(), img.width(), QImage::Format_Indexed8);
+  result.setColorTable(grayColorTable());
+  return result;
+}
+
+/**
+ * Wraps the pixels of a vigra image into an 8-bit grayscale QImage, without
+ * copying. QImage must not be modified, since that would modify the vigra
+ * image.
+ */
+inline QImage wrapImage(const vigra::BImage& img) {
+  return wrapImage(const_cast<vigra::BImage&>(img));
+}
+
+/**
+ * Wraps the pixels of a vigra image into a 24-bit QImage, without copying.
+ * QImage must not be modified, since that would modify the vigra image.
+ */
+inline QImage wrapImage(const vigra::BRGBImage& img) {
+  return QImage(const_cast<uchar*>(reinterpret_cast<const uchar*>(img.data())), img.width(), img.height(), img.width() * 3, QImage::Format_RGB888);
+}
+
+/**
+ * Saves an image to a file, without copying its pixels into an intermediate
+ * QImage. File format is deduced from the file name extension.
+ *
+ * @param img                          Image to save, vigra::BImage or
+ *                                     vigra::BRGBImage.
+ * @param fileName                     Filename of the image.
+ */
+template<class Image>
+void saveImage(const Image& img, const std::string& fileName) {
+  if(!wrapImage(img).save(QString::fromLocal8Bit(fileName.c_str())))
+    throw std::logic_error("Could not save image \"" + fileName + "\".");
+}
+
+#endif // QIMAGE_VIEWS_H
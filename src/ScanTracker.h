@@ -0,0 +1,263 @@
+#ifndef SCAN_TRACKER_H
+#define SCAN_TRACKER_H
+
+#include "config.h"
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <vigra/stdimage.hxx>
+#include "KeypointMatcher.h"
+
+// -------------------------------------------------------------------------- //
+// ScanTracker
+// -------------------------------------------------------------------------- //
+/**
+ * Verifies and refines a transformation from scan coordinates to template
+ * coordinates that is known approximately, e.g. the transformation of the
+ * previous scan from the same sheet feeder.
+ *
+ * A few textured patches are picked from the template image. Each patch is
+ * searched for in the scan around the position predicted by the given
+ * transformation, using normalized cross-correlation. If enough patches are
+ * found, the transformation is refitted to their positions, which is much
+ * cheaper than keypoint extraction and matching.
+ *
+ * Transformations are similarities z -> a * z + b, with points represented
+ * as complex numbers, see KeypointMatcher.
+ */
+class ScanTracker: public boost::noncopyable {
+public:
+  typedef KeypointMatcher::Point Point;
+
+  /**
+   * Constructor.
+   *
+   * @param templateImage              Template image.
+   * @param patchSize                  Size of a patch, in template pixels.
+   * @param searchRadius               Maximal distance between the predicted
+   *                                   and the found patch position, in
+   *                                   template pixels.
+   */
+  explicit ScanTracker(const vigra::BImage& templateImage, int patchSize = TRACKER_PATCH_SIZE, int searchRadius = TRACKER_SEARCH_RADIUS):
+    mPatchSize(patchSize), mSearchRadius(searchRadius)
+  {
+    assert(patchSize > 0 && searchRadius >= 0);
+
+    /* Pick the patch with the largest variance in each cell of a grid, so
+     * that patches are spread over the template. Blank cells are skipped. */
+    int cellWidth = templateImage.width() / TRACKER_PATCH_COLUMNS;
+    int cellHeight = templateImage.height() / TRACKER_PATCH_ROWS;
+    for(int row = 0; row < TRACKER_PATCH_ROWS; row++) {
+      for(int column = 0; column < TRACKER_PATCH_COLUMNS; column++) {
+        double bestVariance = TRACKER_MIN_PATCH_DEVIATION * TRACKER_MIN_PATCH_DEVIATION;
+        int bestX = -1, bestY = -1;
+        for(int y = row * cellHeight; y + patchSize <= (row + 1) * cellHeight; y += 4) {
+          for(int x = column * cellWidth; x + patchSize <= (column + 1) * cellWidth; x += 4) {
+            double variance = patchVariance(templateImage, x, y);
+            if(variance > bestVariance) {
+              bestVariance = variance;
+              bestX = x;
+              bestY = y;
+            }
+          }
+        }
+
+        if(bestX >= 0)
+          addPatch(templateImage, bestX, bestY);
+      }
+    }
+  }
+
+  /**
+   * @returns                          Number of template patches.
+   */
+  int patchCount() const {
+    return static_cast<int>(mPatches.size());
+  }
+
+  /**
+   * Verifies and refines the given transformation.
+   *
+   * @param image                      Scan image.
+   * @param imageScale                 Scale of the original scan relative to
+   *                                   the given image, if the image is
+   *                                   reduced. Transformations are given in
+   *                                   coordinates of the original scan.
+   * @param[in,out] a                  Linear part of the transformation.
+   * @param[in,out] b                  Translation part of the transformation.
+   * @returns                          Whether the transformation was
+   *                                   verified. The refined transformation
+   *                                   is stored only if it was.
+   */
+  bool operator()(const vigra::BImage& image, float imageScale, Point& a, Point& b) const {
+    if(std::norm(a) < 1.0e-12 || mPatches.size() < static_cast<std::size_t>(TRACKER_MIN_PATCHES))
+      return false;
+
+    /* Template to reduced image coordinates, see EncodedImage::reduced()
+     * for the pixel center offset. */
+    Point inverseA = 1.0 / (a * static_cast<double>(imageScale));
+    Point inverseB = (-b / a - Point(0.5 * (imageScale - 1), 0.5 * (imageScale - 1))) / static_cast<double>(imageScale);
+
+    std::vector<KeypointMatcher::PointMatch> matches;
+    std::vector<float> window;
+    for(std::size_t i = 0; i < mPatches.size(); i++) {
+      const Patch& patch = mPatches[i];
+
+      /* Resample the neighbourhood of the predicted patch position into
+       * template coordinates. */
+      int windowSize = mPatchSize + 2 * mSearchRadius;
+      window.resize(windowSize * windowSize);
+      bool inside = true;
+      for(int y = 0; y < windowSize && inside; y++) {
+        for(int x = 0; x < windowSize && inside; x++) {
+          Point p = inverseA * Point(patch.x - mSearchRadius + x, patch.y - mSearchRadius + y) + inverseB;
+          inside = sample(image, p.real(), p.imag(), window[y * windowSize + x]);
+        }
+      }
+      if(!inside)
+        continue;
+
+      /* Find the best correlated shift. */
+      std::vector<double> scores((2 * mSearchRadius + 1) * (2 * mSearchRadius + 1));
+      int bestDx = 0, bestDy = 0;
+      double bestScore = -1.0;
+      for(int dy = -mSearchRadius; dy <= mSearchRadius; dy++) {
+        for(int dx = -mSearchRadius; dx <= mSearchRadius; dx++) {
+          double score = correlation(patch, window, windowSize, dx + mSearchRadius, dy + mSearchRadius);
+          scores[(dy + mSearchRadius) * (2 * mSearchRadius + 1) + dx + mSearchRadius] = score;
+          if(score > bestScore) {
+            bestScore = score;
+            bestDx = dx;
+            bestDy = dy;
+          }
+        }
+      }
+      if(bestScore < TRACKER_MIN_CORRELATION)
+        continue;
+
+      /* Refine to subpixel precision with a parabola through the
+       * neighbouring scores. */
+      double subDx = bestDx, subDy = bestDy;
+      if(bestDx > -mSearchRadius && bestDx < mSearchRadius)
+        subDx += peakOffset(scores, bestDx - 1, bestDy, bestDx, bestDy, bestDx + 1, bestDy);
+      if(bestDy > -mSearchRadius && bestDy < mSearchRadius)
+        subDy += peakOffset(scores, bestDx, bestDy - 1, bestDx, bestDy, bestDx, bestDy + 1);
+
+      /* Patch center in the template was found at the shifted position. */
+      Point center(patch.x + 0.5 * (mPatchSize - 1), patch.y + 0.5 * (mPatchSize - 1));
+      Point found = (inverseA * (center + Point(subDx, subDy)) + inverseB) * static_cast<double>(imageScale) + Point(0.5 * (imageScale - 1), 0.5 * (imageScale - 1));
+      matches.push_back(KeypointMatcher::PointMatch(found, center));
+    }
+
+    /* Refit, dropping the patches that disagree with the fit once. Error is
+     * measured in image pixels. */
+    double maxError = TRACKER_MAX_ERROR * std::abs(a) * imageScale;
+    Point newA, newB;
+    for(int round = 0; round < 2; round++) {
+      if(matches.size() < static_cast<std::size_t>(TRACKER_MIN_PATCHES) || !KeypointMatcher::fit(matches, newA, newB))
+        return false;
+
+      std::vector<KeypointMatcher::PointMatch> inliers;
+      for(std::size_t i = 0; i < matches.size(); i++)
+        if(std::abs(newA * matches[i].first + newB - matches[i].second) <= maxError)
+          inliers.push_back(matches[i]);
+      if(inliers.size() == matches.size()) {
+        a = newA;
+        b = newB;
+        return true;
+      }
+      matches.swap(inliers);
+    }
+    return false;
+  }
+
+private:
+  struct Patch {
+    int x, y;                     /**< Upper left corner in the template. */
+    std::vector<float> pixels;    /**< Zero-mean pixels with unit norm. */
+  };
+
+  double patchVariance(const vigra::BImage& img, int x0, int y0) const {
+    double sum = 0.0, sumSq = 0.0;
+    for(int y = y0; y < y0 + mPatchSize; y++) {
+      for(int x = x0; x < x0 + mPatchSize; x++) {
+        double v = img(x, y);
+        sum += v;
+        sumSq += v * v;
+      }
+    }
+    double n = mPatchSize * mPatchSize;
+    return sumSq / n - (sum / n) * (sum / n);
+  }
+
+  void addPatch(const vigra::BImage& img, int x0, int y0) {
+    Patch patch;
+    patch.x = x0;
+    patch.y = y0;
+    patch.pixels.resize(mPatchSize * mPatchSize);
+
+    double sum = 0.0;
+    for(int y = 0; y < mPatchSize; y++)
+      for(int x = 0; x < mPatchSize; x++)
+        sum += patch.pixels[y * mPatchSize + x] = img(x0 + x, y0 + y);
+
+    float mean = static_cast<float>(sum / patch.pixels.size());
+    double norm = 0.0;
+    for(std::size_t i = 0; i < patch.pixels.size(); i++) {
+      patch.pixels[i] -= mean;
+      norm += patch.pixels[i] * patch.pixels[i];
+    }
+    float scale = static_cast<float>(1.0 / std::sqrt(norm));
+    for(std::size_t i = 0; i < patch.pixels.size(); i++)
+      patch.pixels[i] *= scale;
+
+    mPatches.push_back(patch);
+  }
+
+  static bool sample(const vigra::BImage& img, double x, double y, float& result) {
+    int x0 = static_cast<int>(std::floor(x));
+    int y0 = static_cast<int>(std::floor(y));
+    if(x0 < 0 || y0 < 0 || x0 + 1 >= img.width() || y0 + 1 >= img.height())
+      return false;
+
+    float fx = static_cast<float>(x - x0), fy = static_cast<float>(y - y0);
+    float top = img(x0, y0) + fx * (img(x0 + 1, y0) - img(x0, y0));
+    float bottom = img(x0, y0 + 1) + fx * (img(x0 + 1, y0 + 1) - img(x0, y0 + 1));
+    result = top + fy * (bottom - top);
+    return true;
+  }
+
+  double correlation(const Patch& patch, const std::vector<float>& window, int windowSize, int x0, int y0) const {
+    double sum = 0.0, sumSq = 0.0, dot = 0.0;
+    for(int y = 0; y < mPatchSize; y++) {
+      const float* row = &window[(y0 + y) * windowSize + x0];
+      const float* patchRow = &patch.pixels[y * mPatchSize];
+      for(int x = 0; x < mPatchSize; x++) {
+        sum += row[x];
+        sumSq += row[x] * row[x];
+        dot += row[x] * patchRow[x];
+      }
+    }
+
+    /* Patch pixels are zero-mean, so the window mean does not affect the
+     * dot product. */
+    double variance = sumSq - sum * sum / (mPatchSize * mPatchSize);
+    return variance > 1.0e-6 ? dot / std::sqrt(variance) : 0.0;
+  }
+
+  double peakOffset(const std::vector<double>& scores, int x0, int y0, int x1, int y1, int x2, int y2) const {
+    int stride = 2 * mSearchRadius + 1;
+    double s0 = scores[(y0 + mSearchRadius) * stride + x0 + mSearchRadius];
+    double s1 = scores[(y1 + mSearchRadius) * stride + x1 + mSearchRadius];
+    double s2 = scores[(y2 + mSearchRadius) * stride + x2 + mSearchRadius];
+    double denominator = s0 - 2 * s1 + s2;
+    return denominator < 0 ? 0.5 * (s0 - s2) / denominator : 0.0;
+  }
+
+  int mPatchSize, mSearchRadius;
+  std::vector<Patch> mPatches;
+};
+
+#endif // SCAN_TRACKER_H
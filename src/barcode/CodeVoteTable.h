@@ -0,0 +1,154 @@
+#ifndef BARCODE_CODE_VOTE_TABLE_H
+#define BARCODE_CODE_VOTE_TABLE_H
+
+#include "config.h"
+#include <cassert>
+#include <cstring>   /* for std::memcmp() */
+#include <algorithm> /* for std::min() */
+#include <vector>
+#include <boost/array.hpp>
+#include "ItfCode.h"
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// CodeVoteTable
+// -------------------------------------------------------------------------- //
+  /**
+   * Vote table that counts votes for whole barcodes.
+   *
+   * Table stores barcodes in compact form, one byte per digit pair. Storage
+   * is reserved when the table is cleared and kept between uses, so adding
+   * votes doesn't allocate as long as the number of distinct barcodes stays
+   * within the reserved capacity. Table grows beyond it if needed, votes
+   * are never dropped.
+   */
+  class CodeVoteTable {
+  public:
+    enum {
+      MAX_CODE_LENGTH = 128  /**< Maximal number of digits in a barcode. */
+    };
+
+    CodeVoteTable(): mSize(0), mTotal(0) {}
+
+    /**
+     * Removes all votes from this table.
+     *
+     * @param capacity                 Number of distinct barcodes to reserve
+     *                                 storage for, e.g. the maximal number
+     *                                 of votes to be added.
+     */
+    void clear(int capacity = 0) {
+      if(static_cast<int>(mEntries.size()) < capacity)
+        mEntries.resize(capacity);
+      mSize = 0;
+      mTotal = 0;
+    }
+
+    /**
+     * @returns                        Whether no votes were added to this
+     *                                 table.
+     */
+    bool empty() const {
+      return mTotal == 0;
+    }
+
+    /**
+     * Adds a vote.
+     *
+     * @param code                     Barcode to add a vote for. Barcodes of
+     *                                 odd length, and barcodes longer than
+     *                                 MAX_CODE_LENGTH digits are ignored.
+     */
+    void add(const ItfCode& code) {
+      if(code.size() == 0 || code.size() % 2 != 0 || code.size() > MAX_CODE_LENGTH)
+        return;
+
+      Key key;
+      key.size = code.size();
+      for(int i = 0; i < code.size(); i += 2)
+        key.pairs[i / 2] = static_cast<unsigned char>(code[i] * 10 + code[i + 1]);
+
+      for(int i = 0; i < mSize; i++) {
+        if(mEntries[i].key == key) {
+          mEntries[i].count++;
+          mTotal++;
+          return;
+        }
+      }
+
+      if(mSize == static_cast<int>(mEntries.size()))
+        mEntries.push_back(Entry());
+
+      mEntries[mSize].key = key;
+      mEntries[mSize].count = 1;
+      mSize++;
+      mTotal++;
+    }
+
+    /**
+     * Finds two leading barcodes. Ties are broken in favor of the barcode
+     * that is smaller in ItfCode ordering.
+     *
+     * @param leader[out]              Barcode with the most votes, empty if
+     *                                 there are no votes.
+     * @param leaderCount[out]         Number of votes for the leader.
+     * @param margin[out]              Difference between the number of votes
+     *                                 for the leader and for the runner-up.
+     */
+    void leaders(ItfCode& leader, int& leaderCount, int& margin) const {
+      const Entry* pLeader = NULL;
+      int runnerUpCount = 0;
+      leaderCount = 0;
+      for(int i = 0; i < mSize; i++) {
+        const Entry& entry = mEntries[i];
+        if(entry.count > leaderCount || (entry.count == leaderCount && entry.key < pLeader->key)) {
+          runnerUpCount = leaderCount;
+          pLeader = &entry;
+          leaderCount = entry.count;
+        } else if(entry.count > runnerUpCount) {
+          runnerUpCount = entry.count;
+        }
+      }
+      margin = leaderCount - runnerUpCount;
+
+      leader.clear();
+      if(pLeader != NULL) {
+        for(int i = 0; i < pLeader->key.size / 2; i++) {
+          leader.addDigit(pLeader->key.pairs[i] / 10);
+          leader.addDigit(pLeader->key.pairs[i] % 10);
+        }
+      }
+    }
+
+  private:
+    /**
+     * Barcode in compact form. Digit pairs are compared as bytes, which
+     * gives the same ordering as comparison of digit sequences.
+     */
+    struct Key {
+      int size;
+      boost::array<unsigned char, MAX_CODE_LENGTH / 2> pairs;
+
+      bool operator== (const Key& other) const {
+        return size == other.size && std::memcmp(&pairs[0], &other.pairs[0], size / 2) == 0;
+      }
+
+      bool operator< (const Key& other) const {
+        int result = std::memcmp(&pairs[0], &other.pairs[0], std::min(size, other.size) / 2);
+        return result < 0 || (result == 0 && size < other.size);
+      }
+    };
+
+    struct Entry {
+      Key key;
+      int count;
+    };
+
+    std::vector<Entry> mEntries;
+    int mSize;
+    int mTotal;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_CODE_VOTE_TABLE_H
@@ -0,0 +1,175 @@
+#ifndef BARCODE_CUBIC_SPLINE_IMAGE_H
+#define BARCODE_CUBIC_SPLINE_IMAGE_H
+
+#include "config.h"
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <vigra/stdimage.hxx>
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// CubicSplineImage
+// -------------------------------------------------------------------------- //
+  /**
+   * Cubic B-spline interpolation of an 8-bit image.
+   *
+   * Does the same job as <tt>vigra::SplineImageView<3, UInt8></tt>, but
+   * keeps its coefficients in a buffer that is reused when a new image is
+   * assigned, so recognizing a sequence of barcodes of similar size doesn't
+   * reallocate it.
+   *
+   * Coefficients are computed with the recursive prefilter of Unser et al.
+   * with mirror boundary conditions, same as in vigra.
+   */
+  class CubicSplineImage {
+  public:
+    typedef vigra::BImage::value_type value_type;
+
+    CubicSplineImage(): mWidth(0), mHeight(0) {}
+
+    CubicSplineImage(const vigra::BImage& img) {
+      assign(img);
+    }
+
+    /**
+     * Recomputes spline coefficients for the given image. Storage is
+     * reused if possible.
+     *
+     * @param img                      Image to interpolate.
+     */
+    void assign(const vigra::BImage& img) {
+      assert(img.width() > 0 && img.height() > 0);
+
+      mWidth = img.width();
+      mHeight = img.height();
+      mCoefficients.resize(mWidth * mHeight);
+      mColumn.resize(mHeight);
+
+      for(int y = 0; y < mHeight; y++) {
+        float* row = &mCoefficients[y * mWidth];
+        const value_type* src = img[y];
+        for(int x = 0; x < mWidth; x++)
+          row[x] = src[x];
+        prefilter(row, mWidth);
+      }
+
+      for(int x = 0; x < mWidth; x++) {
+        for(int y = 0; y < mHeight; y++)
+          mColumn[y] = mCoefficients[y * mWidth + x];
+        prefilter(&mColumn[0], mHeight);
+        for(int y = 0; y < mHeight; y++)
+          mCoefficients[y * mWidth + x] = mColumn[y];
+      }
+    }
+
+    int width() const {
+      return mWidth;
+    }
+
+    int height() const {
+      return mHeight;
+    }
+
+    /**
+     * @param x                        X coordinate, in range [0, width - 1].
+     * @param y                        Y coordinate, in range [0, height - 1].
+     * @returns                        Interpolated value at the given point,
+     *                                 rounded and clamped to 8 bits.
+     */
+    value_type operator() (double x, double y) const {
+      assert(x >= 0 && x <= mWidth - 1 && y >= 0 && y <= mHeight - 1);
+
+      int ix = static_cast<int>(std::floor(x)), iy = static_cast<int>(std::floor(y));
+      float wx[4], wy[4];
+      weights(static_cast<float>(x - ix), wx);
+      weights(static_cast<float>(y - iy), wy);
+
+      int xs[4];
+      for(int i = 0; i < 4; i++)
+        xs[i] = mirror(ix - 1 + i, mWidth);
+
+      float sum = 0;
+      for(int j = 0; j < 4; j++) {
+        const float* row = &mCoefficients[mirror(iy - 1 + j, mHeight) * mWidth];
+        sum += wy[j] * (wx[0] * row[xs[0]] + wx[1] * row[xs[1]] + wx[2] * row[xs[2]] + wx[3] * row[xs[3]]);
+      }
+
+      if(sum <= 0.0f)
+        return 0;
+      if(sum >= 255.0f)
+        return 255;
+      return static_cast<value_type>(sum + 0.5f);
+    }
+
+  private:
+    /**
+     * Converts the given samples into cubic B-spline coefficients in-place.
+     */
+    static void prefilter(float* c, int size) {
+      if(size < 2)
+        return;
+
+      const double z = std::sqrt(3.0) - 2.0;
+      for(int i = 0; i < size; i++)
+        c[i] *= 6.0f; /* (1 - z) * (1 - 1 / z) */
+
+      /* Causal initialization for a mirror-symmetric signal. */
+      double zn = z, z2n = std::pow(z, size - 1), iz = 1.0 / z;
+      double sum = c[0] + z2n * c[size - 1];
+      z2n *= z2n * iz;
+      for(int i = 1; i < size - 1; i++) {
+        sum += (zn + z2n) * c[i];
+        zn *= z;
+        z2n *= iz;
+      }
+      c[0] = static_cast<float>(sum / (1.0 - zn * zn));
+
+      for(int i = 1; i < size; i++)
+        c[i] += static_cast<float>(z) * c[i - 1];
+
+      /* Anti-causal initialization. */
+      c[size - 1] = static_cast<float>((z / (z * z - 1.0)) * (z * c[size - 2] + c[size - 1]));
+
+      for(int i = size - 2; i >= 0; i--)
+        c[i] = static_cast<float>(z) * (c[i + 1] - c[i]);
+    }
+
+    /**
+     * Computes cubic B-spline weights for the four samples around a point
+     * with the given fractional offset.
+     */
+    static void weights(float t, float* w) {
+      float t2 = t * t, t3 = t2 * t, s = 1.0f - t;
+      w[0] = s * s * s / 6.0f;
+      w[1] = (4.0f - 6.0f * t2 + 3.0f * t3) / 6.0f;
+      w[2] = (1.0f + 3.0f * t + 3.0f * t2 - 3.0f * t3) / 6.0f;
+      w[3] = t3 / 6.0f;
+    }
+
+    /**
+     * @returns                        Index reflected about the borders of
+     *                                 a signal of the given size. Reflection
+     *                                 is repeated as many times as needed,
+     *                                 so that signals shorter than the
+     *                                 spline support are handled too.
+     */
+    static int mirror(int i, int size) {
+      if(size == 1)
+        return 0;
+      int period = 2 * size - 2;
+      i = (i < 0 ? -i : i) % period;
+      if(i >= size)
+        i = period - i;
+      return i;
+    }
+
+    int mWidth;
+    int mHeight;
+    std::vector<float> mCoefficients;
+    std::vector<float> mColumn;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_CUBIC_SPLINE_IMAGE_H
@@ -0,0 +1,141 @@
+#ifndef BARCODE_DIGIT_VOTE_TABLE_H
+#define BARCODE_DIGIT_VOTE_TABLE_H
+
+#include "config.h"
+#include <algorithm> /* for std::min() and std::fill() */
+#include <map>
+#include <vector>
+#include "ItfCode.h"
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// DigitVoteTable
+// -------------------------------------------------------------------------- //
+  /**
+   * Vote table that counts votes for each digit position separately.
+   *
+   * Trials that differ in a single digit still agree on all the other
+   * positions, so a smudged digit pair doesn't split the vote for the
+   * whole barcode.
+   *
+   * Only trials that produced barcodes of the leading length are combined.
+   * Length is fixed by the caller if known.
+   */
+  class DigitVoteTable {
+  public:
+    /**
+     * Constructor.
+     *
+     * @param codeLength               Number of digits in the barcode, zero
+     *                                 if not known.
+     */
+    DigitVoteTable(int codeLength = 0): mCodeLength(codeLength), mLength(codeLength), mTotal(0) {}
+
+    /**
+     * Removes all votes from this table. Storage for the vote counts is
+     * kept, so that the table can be reused without reallocation.
+     *
+     * @param codeLength               Number of digits in the barcode, zero
+     *                                 if not known.
+     */
+    void clear(int codeLength = 0) {
+      mCodeLength = mLength = codeLength;
+      mTotal = 0;
+      for(std::map<int, Length>::iterator pos = mLengths.begin(); pos != mLengths.end(); ++pos) {
+        pos->second.votes = 0;
+        std::fill(pos->second.digits.begin(), pos->second.digits.end(), 0);
+      }
+    }
+
+    /**
+     * @returns                        Whether no votes were added to this
+     *                                 table.
+     */
+    bool empty() const {
+      return mTotal == 0;
+    }
+
+    /**
+     * Adds a vote.
+     *
+     * @param code                     Barcode to add a vote for.
+     */
+    void add(const ItfCode& code) {
+      if(code.size() == 0 || (mCodeLength != 0 && code.size() != mCodeLength))
+        return;
+
+      Length& length = mLengths[code.size()];
+      if(length.digits.empty())
+        length.digits.resize(code.size() * 10, 0);
+      length.votes++;
+      for(int i = 0; i < code.size(); i++)
+        length.digits[i * 10 + code[i]]++;
+      mTotal++;
+
+      if(mLength == 0 || length.votes > mLengths[mLength].votes)
+        mLength = code.size();
+    }
+
+    /**
+     * Finds the leading digit at each position.
+     *
+     * @param leader[out]              Barcode made of the leading digits,
+     *                                 empty if there are no votes.
+     * @param leaderCount[out]         Smallest number of votes for a leading
+     *                                 digit among all positions.
+     * @param margin[out]              Smallest vote margin between a leading
+     *                                 digit and the runner-up among all
+     *                                 positions.
+     */
+    void leaders(ItfCode& leader, int& leaderCount, int& margin) const {
+      leader.clear();
+      leaderCount = margin = 0;
+
+      std::map<int, Length>::const_iterator pos = mLengths.find(mLength);
+      if(pos == mLengths.end() || pos->second.votes == 0)
+        return;
+
+      const std::vector<int>& digits = pos->second.digits;
+      leaderCount = margin = pos->second.votes;
+      for(int i = 0; i < mLength; i++) {
+        int best = 0, bestCount = 0, runnerUpCount = 0;
+        for(int digit = 0; digit < 10; digit++) {
+          int count = digits[i * 10 + digit];
+          if(count > bestCount) {
+            runnerUpCount = bestCount;
+            best = digit;
+            bestCount = count;
+          } else if(count > runnerUpCount) {
+            runnerUpCount = count;
+          }
+        }
+
+        leader.addDigit(best);
+        leaderCount = std::min(leaderCount, bestCount);
+        margin = std::min(margin, bestCount - runnerUpCount);
+      }
+    }
+
+  private:
+    /**
+     * Votes for barcodes of a single length.
+     */
+    struct Length {
+      Length(): votes(0) {}
+
+      /** Number of votes for barcodes of this length. */
+      int votes;
+
+      /** Vote counts, ten per digit position. */
+      std::vector<int> digits;
+    };
+
+    int mCodeLength;
+    int mLength;
+    int mTotal;
+    std::map<int, Length> mLengths;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_DIGIT_VOTE_TABLE_H
@@ -0,0 +1,389 @@
+#ifndef BARCODE_ITF_DECODER_H
+#define BARCODE_ITF_DECODER_H
+
+#include "config.h"
+#include <cassert>
+#include <cmath>     /* for std::exp() */
+#include <algorithm> /* for std::nth_element() */
+#include <limits>
+#include <vector>
+#include <arx/Foreach.h>
+#include "ItfEncoding.h"
+#include "ItfCode.h"
+#include "ItfSchema.h"
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// ItfDecoder
+// -------------------------------------------------------------------------- //
+  /**
+   * Soft-decision decoder for Interleaved 2 of 5 segment widths.
+   *
+   * Instead of classifying each segment as narrow or wide and looking the
+   * resulting 5-bar groups up in the decoding table, this decoder assigns
+   * each digit at each position a cost computed from the measured widths
+   * of its bars, and then finds the cheapest digit sequence with a Viterbi
+   * pass over a trellis whose states are partial mod 10 checksums. A single
+   * misjudged bar therefore only makes the correct digit more expensive,
+   * instead of invalidating the whole sequence.
+   *
+   * Narrow and wide widths are estimated separately for black and white
+   * bars, as ink spread makes black bars wider than white ones.
+   *
+   * Confidence of each digit is derived from max-marginals, i.e. from the
+   * costs of the best sequences that have other digits at the same position.
+   */
+  class ItfDecoder {
+  public:
+    /**
+     * Scratch buffers for a single decoding thread.
+     */
+    struct Buffers {
+      std::vector<double> widths[2];
+      std::vector<double> costs;
+      std::vector<double> forward;
+      std::vector<double> backward;
+      std::vector<int> path;
+    };
+
+    /**
+     * Constructor.
+     *
+     * Constructs a decoder that accepts barcodes of any length and doesn't
+     * check the checksum.
+     */
+    ItfDecoder(): mMinConfidence(0.5), mMaxMeanCost(0.3) {}
+
+    /**
+     * @param codeLength               Number of digits in a barcode, zero
+     *                                 to accept barcodes of any length.
+     */
+    void setCodeLength(int codeLength) {
+      mSchema.setLength(codeLength);
+    }
+
+    int codeLength() const {
+      return mSchema.length();
+    }
+
+    /**
+     * @param checkSum                 Whether decoded barcodes must pass the
+     *                                 mod 10 checksum. The constraint is
+     *                                 enforced during decoding, so a barcode
+     *                                 with a misread digit is corrected to
+     *                                 the most likely valid one.
+     */
+    void setCheckSum(bool checkSum) {
+      mSchema.setCheckSum(checkSum);
+    }
+
+    bool checkSum() const {
+      return mSchema.checkSum();
+    }
+
+    /**
+     * @param schema                   Known structure of the barcodes. Digits
+     *                                 that are not allowed at their positions
+     *                                 are never decoded, and length and 
+     *                                 checksum are enforced as above. Numeric
+     *                                 fields are not checked by the decoder.
+     */
+    void setSchema(const ItfSchema& schema) {
+      mSchema = schema;
+    }
+
+    const ItfSchema& schema() const {
+      return mSchema;
+    }
+
+    /**
+     * @param minConfidence            Minimal confidence of a digit. Decoding
+     *                                 fails if any of the digits is less
+     *                                 certain.
+     */
+    void setMinConfidence(double minConfidence) {
+      assert(minConfidence >= 0 && minConfidence <= 1);
+
+      mMinConfidence = minConfidence;
+    }
+
+    double minConfidence() const {
+      return mMinConfidence;
+    }
+
+    /**
+     * @param maxMeanCost              Maximal cost of the decoded sequence
+     *                                 per segment. A cost of 0.5 means that
+     *                                 segment widths deviate from their class
+     *                                 centers by one standard deviation on 
+     *                                 average. Decoding of sequences that fit
+     *                                 worse fails, as these are most likely 
+     *                                 not barcodes at all.
+     */
+    void setMaxMeanCost(double maxMeanCost) {
+      assert(maxMeanCost > 0);
+
+      mMaxMeanCost = maxMeanCost;
+    }
+
+    double maxMeanCost() const {
+      return mMaxMeanCost;
+    }
+
+    /**
+     * Decodes the given sequence of segment widths.
+     *
+     * @param segments                 Widths of the segments, starting with
+     *                                 the first black bar of the head and
+     *                                 ending with the last black bar of the
+     *                                 tail.
+     * @param code[out]                Decoded barcode.
+     * @param confidences[out]         Confidence of each of the decoded
+     *                                 digits, in range [0, 1].
+     * @param buffers                  Scratch buffers.
+     * @returns                        Whether decoding was successful.
+     */
+    template<class T>
+    bool operator()(const std::vector<T>& segments, ItfCode& code, std::vector<double>& confidences, Buffers& buffers) const {
+      code.clear();
+      confidences.clear();
+
+      if(segments.size() % 10 != 7)
+        return false;
+
+      int pairs = static_cast<int>(segments.size()) / 10;
+      if(pairs == 0 || (codeLength() != 0 && codeLength() != 2 * pairs))
+        return false;
+
+      double bestCost = std::numeric_limits<double>::infinity();
+      for(int inverted = 0; inverted < 2; inverted++) {
+        double cost;
+        if(!decode(segments, inverted != 0, cost, buffers) || cost >= bestCost)
+          continue;
+
+        bestCost = cost;
+        code.clear();
+        confidences.clear();
+        for(int i = 0; i < 2 * pairs; i++) {
+          code.addDigit(buffers.path[i]);
+          confidences.push_back(confidence(buffers, i, buffers.path[i]));
+        }
+      }
+
+      if(code.size() == 0)
+        return false;
+
+      if(bestCost > mMaxMeanCost * segments.size()) {
+        code.clear();
+        confidences.clear();
+        return false;
+      }
+
+      foreach(double value, confidences) {
+        if(value < mMinConfidence) {
+          code.clear();
+          confidences.clear();
+          return false;
+        }
+      }
+      return true;
+    }
+
+  private:
+    enum {
+      DIGITS = 10
+    };
+
+    /**
+     * Runs the decoder for one of the encodings.
+     *
+     * @param cost[out]                Total cost of the best sequence,
+     *                                 including head and tail.
+     * @returns                        Whether a valid sequence was found.
+     */
+    template<class T>
+    bool decode(const std::vector<T>& segments, bool inverted, double& cost, Buffers& buffers) const {
+      int pairs = static_cast<int>(segments.size()) / 10;
+      int length = 2 * pairs;
+      const int (*encoding)[5] = inverted ? ItfEncoding::invertedEncoding : ItfEncoding::encoding;
+      const int* flatHead = inverted ? ItfEncoding::invertedFlatHead : ItfEncoding::flatHead;
+      const int* flatTail = inverted ? ItfEncoding::invertedFlatTail : ItfEncoding::flatTail;
+      std::size_t tailStart = 4 + 10 * pairs;
+
+      /* Estimate narrow and wide widths for each color. The number of wide
+       * bars of each color is known exactly, as every digit has the same
+       * number of wide bars. */
+      int digitWide = 0;
+      for(int j = 0; j < 5; j++)
+        digitWide += encoding[0][j];
+
+      double narrow[2], wide[2];
+      for(int color = 0; color < 2; color++) {
+        std::vector<double>& widths = buffers.widths[color];
+        widths.clear();
+        int wideCount = pairs * digitWide;
+        for(std::size_t i = color; i < segments.size(); i += 2) {
+          widths.push_back(static_cast<double>(segments[i]));
+          if(i < 4)
+            wideCount += flatHead[i];
+          else if(i >= tailStart)
+            wideCount += flatTail[i - tailStart];
+        }
+
+        int narrowCount = static_cast<int>(widths.size()) - wideCount;
+        if(narrowCount <= 0 || wideCount <= 0)
+          return false;
+
+        std::nth_element(widths.begin(), widths.begin() + narrowCount, widths.end());
+        narrow[color] = mean(widths.begin(), widths.begin() + narrowCount);
+        wide[color] = mean(widths.begin() + narrowCount, widths.end());
+        if(wide[color] <= narrow[color])
+          return false;
+      }
+
+      /* Head & tail don't depend on the digits, but are needed to choose
+       * between normal and inverted encodings. */
+      double guardCost = 0;
+      for(std::size_t i = 0; i < 4; i++)
+        guardCost += barCost(segments[i], i % 2, flatHead[i], narrow, wide);
+      for(std::size_t i = tailStart; i < segments.size(); i++)
+        guardCost += barCost(segments[i], i % 2, flatTail[i - tailStart], narrow, wide);
+
+      /* Compute digit costs. Digits at even positions are encoded by black
+       * bars of a 10-bar group, digits at odd positions by white bars. 
+       * Digits that the schema doesn't allow are never chosen. */
+      const double infinity = std::numeric_limits<double>::infinity();
+      std::vector<double>& costs = buffers.costs;
+      costs.resize(length * DIGITS);
+      for(int pos = 0; pos < length; pos++) {
+        int color = pos % 2;
+        std::size_t first = 4 + 10 * (pos / 2) + color;
+        for(int digit = 0; digit < DIGITS; digit++) {
+          if(!mSchema.isAllowed(pos, digit)) {
+            costs[pos * DIGITS + digit] = infinity;
+            continue;
+          }
+
+          double digitCost = 0;
+          for(int j = 0; j < 5; j++)
+            digitCost += barCost(segments[first + 2 * j], color, encoding[digit][j], narrow, wide);
+          costs[pos * DIGITS + digit] = digitCost;
+        }
+      }
+
+      /* Forward and backward passes over the checksum trellis. */
+      int states = stateCount();
+      std::vector<double>& forward = buffers.forward;
+      std::vector<double>& backward = buffers.backward;
+      forward.assign((length + 1) * states, infinity);
+      backward.assign((length + 1) * states, infinity);
+      forward[0] = 0;
+      backward[length * states] = 0;
+      for(int pos = 0; pos < length; pos++)
+        for(int state = 0; state < states; state++)
+          if(forward[pos * states + state] < infinity)
+            for(int digit = 0; digit < DIGITS; digit++)
+              relax(forward[(pos + 1) * states + nextState(state, pos, digit)], forward[pos * states + state] + costs[pos * DIGITS + digit]);
+      for(int pos = length - 1; pos >= 0; pos--)
+        for(int state = 0; state < states; state++)
+          for(int digit = 0; digit < DIGITS; digit++)
+            relax(backward[pos * states + state], backward[(pos + 1) * states + nextState(state, pos, digit)] + costs[pos * DIGITS + digit]);
+
+      if(!(forward[length * states] < infinity))
+        return false;
+
+      /* Trace the best path. */
+      std::vector<int>& path = buffers.path;
+      path.resize(length);
+      int state = 0;
+      for(int pos = 0; pos < length; pos++) {
+        int bestDigit = 0;
+        double bestCost = infinity;
+        for(int digit = 0; digit < DIGITS; digit++) {
+          double pathCost = forward[pos * states + state] + costs[pos * DIGITS + digit] + backward[(pos + 1) * states + nextState(state, pos, digit)];
+          if(pathCost < bestCost) {
+            bestCost = pathCost;
+            bestDigit = digit;
+          }
+        }
+        path[pos] = bestDigit;
+        state = nextState(state, pos, bestDigit);
+      }
+
+      cost = forward[length * states] + guardCost;
+      return true;
+    }
+
+    /**
+     * Computes the confidence of the given digit at the given position from
+     * the max-marginals of the last decoding pass.
+     */
+    double confidence(const Buffers& buffers, int pos, int digit) const {
+      int states = stateCount();
+      double marginals[DIGITS];
+      for(int d = 0; d < DIGITS; d++) {
+        marginals[d] = std::numeric_limits<double>::infinity();
+        for(int state = 0; state < states; state++)
+          relax(marginals[d], buffers.forward[pos * states + state] + buffers.costs[pos * DIGITS + d] + buffers.backward[(pos + 1) * states + nextState(state, pos, d)]);
+      }
+
+      double sum = 0;
+      for(int d = 0; d < DIGITS; d++)
+        sum += std::exp(marginals[digit] - marginals[d]);
+      return 1.0 / sum;
+    }
+
+    int stateCount() const {
+      return checkSum() ? 10 : 1;
+    }
+
+    /**
+     * @returns                        Trellis state after adding the given
+     *                                 digit at the given position. Digits at
+     *                                 even positions have weight 3 in the
+     *                                 checksum.
+     */
+    int nextState(int state, int pos, int digit) const {
+      return checkSum() ? (state + (pos % 2 == 0 ? 3 : 1) * digit) % 10 : 0;
+    }
+
+    /**
+     * @returns                        Negative log-likelihood of a bar of the
+     *                                 given width being narrow or wide, up to
+     *                                 a constant. Widths are assumed to be
+     *                                 normally distributed around the class
+     *                                 centers, with standard deviation
+     *                                 proportional to the distance between
+     *                                 the centers.
+     */
+    template<class T>
+    static double barCost(T width, int color, int isWide, const double* narrow, const double* wide) {
+      static const double sigma = 0.2;
+
+      double center = isWide ? wide[color] : narrow[color];
+      double d = (width - center) / (wide[color] - narrow[color]);
+      return d * d / (2 * sigma * sigma);
+    }
+
+    static void relax(double& target, double value) {
+      if(value < target)
+        target = value;
+    }
+
+    template<class Iterator>
+    static double mean(Iterator begin, Iterator end) {
+      double sum = 0;
+      int count = 0;
+      for(; begin != end; ++begin, count++)
+        sum += *begin;
+      return sum / count;
+    }
+
+    ItfSchema mSchema;
+    double mMinConfidence;
+    double mMaxMeanCost;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_ITF_DECODER_H
@@ -0,0 +1,53 @@
+#ifndef BARCODE_ITF_DETECTION_H
+#define BARCODE_ITF_DETECTION_H
+
+#include "config.h"
+#include "ItfLocation.h"
+#include "ItfResult.h"
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// ItfDetection
+// -------------------------------------------------------------------------- //
+  /**
+   * Interleaved 2 of 5 barcode found in an image, together with its
+   * location.
+   */
+  class ItfDetection {
+  public:
+    /**
+     * Constructor.
+     *
+     * @param location                 Location of the barcode, oriented in
+     *                                 the reading direction.
+     * @param result                   Recognition result.
+     */
+    ItfDetection(const ItfLocation& location, const ItfResult& result): mLocation(location), mResult(result) {}
+
+    const ItfLocation& location() const {
+      return mLocation;
+    }
+
+    const ItfResult& result() const {
+      return mResult;
+    }
+
+    const ItfCode& code() const {
+      return mResult.code();
+    }
+
+    /**
+     * @see ItfResult::confidence()
+     */
+    double confidence() const {
+      return mResult.confidence();
+    }
+
+  private:
+    ItfLocation mLocation;
+    ItfResult mResult;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_ITF_DETECTION_H
@@ -0,0 +1,124 @@
+#ifndef BARCODE_ITF_LOCATION_H
+#define BARCODE_ITF_LOCATION_H
+
+#include "config.h"
+#include <cmath>
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// ItfLocation
+// -------------------------------------------------------------------------- //
+  /**
+   * Oriented rectangle that contains an Interleaved 2 of 5 barcode.
+   *
+   * Barcode axis goes across the bars, in the reading direction. Since the
+   * reading direction can't be told from the bars alone, a barcode that
+   * fails to read may need to be tried with the flipped location.
+   */
+  class ItfLocation {
+  public:
+    /**
+     * Default constructor.
+     *
+     * Constructs empty location.
+     */
+    ItfLocation(): mX(0), mY(0), mAngle(0), mLength(0), mHeight(0), mScore(0) {}
+
+    /**
+     * Constructor.
+     *
+     * @param x                        X coordinate of the center.
+     * @param y                        Y coordinate of the center.
+     * @param angle                    Angle between the x axis and the
+     *                                 barcode axis, in radians.
+     * @param length                   Extent along the barcode axis.
+     * @param height                   Extent across the barcode axis.
+     * @param score                    Detection score, larger is better.
+     */
+    ItfLocation(double x, double y, double angle, double length, double height, double score):
+      mX(x), mY(y), mAngle(angle), mLength(length), mHeight(height), mScore(score) {}
+
+    double x() const {
+      return mX;
+    }
+
+    double y() const {
+      return mY;
+    }
+
+    double angle() const {
+      return mAngle;
+    }
+
+    double length() const {
+      return mLength;
+    }
+
+    double height() const {
+      return mHeight;
+    }
+
+    double score() const {
+      return mScore;
+    }
+
+    /**
+     * @returns                        Whether this location is empty.
+     */
+    bool isEmpty() const {
+      return mLength <= 0 || mHeight <= 0;
+    }
+
+    /**
+     * @returns                        The same rectangle with the reading
+     *                                 direction reversed.
+     */
+    ItfLocation flipped() const {
+      return ItfLocation(mX, mY, mAngle + M_PI, mLength, mHeight, mScore);
+    }
+
+    /**
+     * @param factor                   Scale factor.
+     * @returns                        This rectangle in an image that is
+     *                                 scaled by the given factor.
+     */
+    ItfLocation scaled(double factor) const {
+      return ItfLocation(mX * factor, mY * factor, mAngle, mLength * factor, mHeight * factor, mScore);
+    }
+
+    /**
+     * @param dx                       Shift along the x axis.
+     * @param dy                       Shift along the y axis.
+     * @returns                        This rectangle shifted by the given
+     *                                 offset.
+     */
+    ItfLocation translated(double dx, double dy) const {
+      return ItfLocation(mX + dx, mY + dy, mAngle, mLength, mHeight, mScore);
+    }
+
+    /**
+     * @returns                        Half-width of the axis-aligned
+     *                                 bounding box of this rectangle.
+     */
+    double xExtent() const {
+      return 0.5 * (std::abs(std::cos(mAngle)) * mLength + std::abs(std::sin(mAngle)) * mHeight);
+    }
+
+    /**
+     * @returns                        Half-height of the axis-aligned
+     *                                 bounding box of this rectangle.
+     */
+    double yExtent() const {
+      return 0.5 * (std::abs(std::sin(mAngle)) * mLength + std::abs(std::cos(mAngle)) * mHeight);
+    }
+
+  private:
+    double mX, mY;
+    double mAngle;
+    double mLength, mHeight;
+    double mScore;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_ITF_LOCATION_H
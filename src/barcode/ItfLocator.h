@@ -0,0 +1,347 @@
+#ifndef BARCODE_ITF_LOCATOR_H
+#define BARCODE_ITF_LOCATOR_H
+
+#include "config.h"
+#include <cassert>
+#include <cmath>
+#include <algorithm> /* for std::sort(), std::fill(), std::min() and std::max() */
+#include <limits>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <vigra/stdimage.hxx>
+#include "ItfLocation.h"
+#include "LineSampler.h"
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// ItfLocator
+// -------------------------------------------------------------------------- //
+  /**
+   * Functor that finds Interleaved 2 of 5 barcodes in an image at any angle.
+   *
+   * The image is split into square cells, and a structure tensor of the
+   * image gradient is accumulated for each cell. Cells covered by a barcode
+   * have strong gradients that all point in the same direction, i.e. high
+   * energy and high orientation coherence. Text has strong gradients too,
+   * but its orientation is mixed, and ruling lines are coherent, but have
+   * little energy per cell.
+   *
+   * Connected groups of such cells with similar orientations are reported
+   * as oriented rectangles, best first.
+   */
+  class ItfLocator {
+  public:
+    /**
+     * Default constructor.
+     */
+    ItfLocator(): mCellSize(16), mMinCoherence(0.6), mMinEnergy(0.25), mMinCells(6) {}
+
+    /**
+     * @param cellSize                 Size of a cell, in pixels. Should be
+     *                                 several times larger than the width of
+     *                                 a wide bar and smaller than the bar
+     *                                 height.
+     */
+    void setCellSize(int cellSize) {
+      assert(cellSize > 1 && cellSize <= 64);
+
+      mCellSize = cellSize;
+    }
+
+    int cellSize() const {
+      return mCellSize;
+    }
+
+    /**
+     * @param minCoherence             Minimal orientation coherence of a
+     *                                 barcode cell, in range [0, 1].
+     */
+    void setMinCoherence(double minCoherence) {
+      assert(minCoherence >= 0 && minCoherence <= 1);
+
+      mMinCoherence = minCoherence;
+    }
+
+    double minCoherence() const {
+      return mMinCoherence;
+    }
+
+    /**
+     * @param minEnergy                Minimal gradient energy of a barcode
+     *                                 cell, as a fraction of the largest
+     *                                 energy of a coherent cell.
+     */
+    void setMinEnergy(double minEnergy) {
+      assert(minEnergy >= 0 && minEnergy <= 1);
+
+      mMinEnergy = minEnergy;
+    }
+
+    double minEnergy() const {
+      return mMinEnergy;
+    }
+
+    /**
+     * @param minCells                 Minimal number of cells in a barcode.
+     */
+    void setMinCells(int minCells) {
+      assert(minCells > 0);
+
+      mMinCells = minCells;
+    }
+
+    int minCells() const {
+      return mMinCells;
+    }
+
+    /**
+     * @param img                      Image to search.
+     * @returns                        Location of the best barcode candidate,
+     *                                 or empty location if nothing was found.
+     */
+    ItfLocation operator() (const vigra::BImage& img) const {
+      std::vector<ItfLocation> locations;
+      locate(img, locations);
+      return locations.empty() ? ItfLocation() : locations.front();
+    }
+
+    /**
+     * Finds all barcode candidates in the given image.
+     *
+     * @param img                      Image to search.
+     * @param locations[out]           Barcode candidates, best first.
+     */
+    void locate(const vigra::BImage& img, std::vector<ItfLocation>& locations) const {
+      locations.clear();
+
+      int cols = img.width() / mCellSize, rows = img.height() / mCellSize;
+      if(cols == 0 || rows == 0)
+        return;
+
+      std::vector<Cell> cells;
+      computeCells(img, cols, rows, cells);
+
+      /* Mark barcode cells. */
+      double maxEnergy = 0;
+      for(std::size_t i = 0; i < cells.size(); i++)
+        if(cells[i].coherence >= mMinCoherence)
+          maxEnergy = std::max(maxEnergy, cells[i].energy);
+      if(maxEnergy == 0)
+        return;
+
+      std::vector<char> marked(cells.size(), 0);
+      for(std::size_t i = 0; i < cells.size(); i++)
+        marked[i] = cells[i].coherence >= mMinCoherence && cells[i].energy >= mMinEnergy * maxEnergy;
+
+      /* Grow regions of cells with similar orientations. Orientations are
+       * compared as doubled angles, so that opposite gradients match. */
+      const double minDirectionDot = std::cos(2 * maxAngleDifference());
+      std::vector<int> stack, region;
+      for(std::size_t seed = 0; seed < cells.size(); seed++) {
+        if(!marked[seed])
+          continue;
+
+        region.clear();
+        stack.assign(1, static_cast<int>(seed));
+        marked[seed] = 0;
+        while(!stack.empty()) {
+          int index = stack.back();
+          stack.pop_back();
+          region.push_back(index);
+
+          int col = index % cols, row = index / cols;
+          for(int dy = -1; dy <= 1; dy++) {
+            for(int dx = -1; dx <= 1; dx++) {
+              int c = col + dx, r = row + dy;
+              if(c < 0 || r < 0 || c >= cols || r >= rows)
+                continue;
+
+              int neighbour = r * cols + c;
+              if(marked[neighbour] && cells[index].dx * cells[neighbour].dx + cells[index].dy * cells[neighbour].dy >= minDirectionDot) {
+                marked[neighbour] = 0;
+                stack.push_back(neighbour);
+              }
+            }
+          }
+        }
+
+        if(static_cast<int>(region.size()) >= mMinCells)
+          locations.push_back(refine(img, fit(cells, region, cols)));
+      }
+
+      std::sort(locations.begin(), locations.end(), &betterScore);
+    }
+
+    /**
+     * Extracts the given oriented rectangle from an image, so that the
+     * barcode axis becomes horizontal in the output image.
+     *
+     * @param img                      Source image.
+     * @param location                 Rectangle to extract.
+     * @param out[out]                 Output image.
+     */
+    static void crop(const vigra::BImage& img, const ItfLocation& location, vigra::BImage& out) {
+      assert(!location.isEmpty());
+
+      int width = std::max(5, static_cast<int>(std::ceil(location.length())));
+      int height = std::max(5, static_cast<int>(std::ceil(location.height())));
+      out.resize(width, height);
+
+      double c = std::cos(location.angle()), s = std::sin(location.angle());
+      for(int y = 0; y < height; y++) {
+        double u = -0.5 * width, v = y - 0.5 * height;
+        LineSampler::bilinear(img, location.x() + c * u - s * v, location.y() + s * u + c * v, c, s, width, out[y]);
+      }
+    }
+
+  private:
+    /**
+     * Gradient statistics of a single cell.
+     */
+    struct Cell {
+      /** Mean squared gradient magnitude. */
+      double energy;
+
+      /** Orientation coherence, in range [0, 1]. */
+      double coherence;
+
+      /** Unit vector of the doubled gradient angle. */
+      double dx, dy;
+
+      /** Structure tensor components. */
+      double xx, yy, xy;
+    };
+
+    static double maxAngleDifference() {
+      return 15.0 * M_PI / 180.0;
+    }
+
+    static bool betterScore(const ItfLocation& a, const ItfLocation& b) {
+      return a.score() > b.score();
+    }
+
+    /**
+     * Accumulates structure tensors of all cells.
+     */
+    void computeCells(const vigra::BImage& img, int cols, int rows, std::vector<Cell>& cells) const {
+      std::vector<boost::int64_t> sums(cols * rows * 3, 0);
+
+      int width = cols * mCellSize, height = rows * mCellSize;
+      for(int y = 1; y < std::min(height, img.height() - 1); y++) {
+        const vigra::UInt8* prev = img[y - 1];
+        const vigra::UInt8* curr = img[y];
+        const vigra::UInt8* next = img[y + 1];
+        boost::int64_t* row = &sums[(y / mCellSize) * cols * 3];
+        for(int x = 1; x < std::min(width, img.width() - 1); x++) {
+          int gx = curr[x + 1] - curr[x - 1];
+          int gy = next[x] - prev[x];
+          boost::int64_t* cell = row + (x / mCellSize) * 3;
+          cell[0] += gx * gx;
+          cell[1] += gy * gy;
+          cell[2] += gx * gy;
+        }
+      }
+
+      cells.resize(cols * rows);
+      double area = static_cast<double>(mCellSize) * mCellSize;
+      for(int i = 0; i < cols * rows; i++) {
+        Cell& cell = cells[i];
+        cell.xx = static_cast<double>(sums[i * 3 + 0]);
+        cell.yy = static_cast<double>(sums[i * 3 + 1]);
+        cell.xy = static_cast<double>(sums[i * 3 + 2]);
+
+        double trace = cell.xx + cell.yy;
+        double difference = std::sqrt((cell.xx - cell.yy) * (cell.xx - cell.yy) + 4 * cell.xy * cell.xy);
+        cell.energy = trace / area;
+        cell.coherence = trace > 0 ? difference / trace : 0;
+        cell.dx = difference > 0 ? (cell.xx - cell.yy) / difference : 1;
+        cell.dy = difference > 0 ? 2 * cell.xy / difference : 0;
+      }
+    }
+
+    /**
+     * Fits an oriented rectangle to a region of cells.
+     */
+    ItfLocation fit(const std::vector<Cell>& cells, const std::vector<int>& region, int cols) const {
+      /* Orientation of the summed tensor. */
+      double xx = 0, yy = 0, xy = 0, score = 0;
+      for(std::size_t i = 0; i < region.size(); i++) {
+        const Cell& cell = cells[region[i]];
+        xx += cell.xx;
+        yy += cell.yy;
+        xy += cell.xy;
+        score += cell.coherence;
+      }
+      double angle = 0.5 * std::atan2(2 * xy, xx - yy); /* In [-pi/2, pi/2], i.e. reading left to right. */
+      double c = std::cos(angle), s = std::sin(angle);
+
+      /* Extents of cell centers along and across the barcode axis. */
+      double uMin = std::numeric_limits<double>::max(), uMax = -uMin, vMin = uMin, vMax = -uMin;
+      for(std::size_t i = 0; i < region.size(); i++) {
+        double x = (region[i] % cols + 0.5) * mCellSize, y = (region[i] / cols + 0.5) * mCellSize;
+        double u = c * x + s * y, v = -s * x + c * y;
+        uMin = std::min(uMin, u);
+        uMax = std::max(uMax, u);
+        vMin = std::min(vMin, v);
+        vMax = std::max(vMax, v);
+      }
+
+      /* Add quiet zones along the axis, as the outermost bars may fall
+       * into cells that didn't pass the thresholds. Across the axis,
+       * stay inside the outer cells so that the band has bars only. */
+      double length = uMax - uMin + 5 * mCellSize;
+      double height = vMax - vMin + 0.5 * mCellSize;
+      double u = 0.5 * (uMin + uMax), v = 0.5 * (vMin + vMax);
+      return ItfLocation(c * u - s * v, s * u + c * v, angle, length, height, score);
+    }
+
+    /**
+     * Refines the angle of a location by maximizing the sharpness of the
+     * image profile along the barcode axis.
+     *
+     * Gradient orientations of narrow bars are biased towards the diagonals,
+     * and even a couple of degrees of error across the length of a barcode
+     * is enough for a scanline to leave the bars.
+     */
+    ItfLocation refine(const vigra::BImage& img, const ItfLocation& location) const {
+      static const int rows = 8;
+      static const int steps = 20;
+      static const double step = 0.25 * M_PI / 180.0;
+
+      int length = static_cast<int>(std::ceil(location.length()));
+      std::vector<int> profile(length);
+      std::vector<vigra::UInt8> line(length);
+
+      double bestAngle = location.angle(), bestSharpness = -1;
+      for(int i = -steps; i <= steps; i++) {
+        double angle = location.angle() + i * step, c = std::cos(angle), s = std::sin(angle);
+
+        std::fill(profile.begin(), profile.end(), 0);
+        for(int row = 0; row < rows; row++) {
+          double u = -0.5 * length, v = location.height() * ((row + 0.5) / rows - 0.5);
+          LineSampler::bilinear(img, location.x() + c * u - s * v, location.y() + s * u + c * v, c, s, length, &line[0]);
+          for(int j = 0; j < length; j++)
+            profile[j] += line[j];
+        }
+
+        double sharpness = 0;
+        for(int j = 1; j < length; j++)
+          sharpness += static_cast<double>(profile[j] - profile[j - 1]) * (profile[j] - profile[j - 1]);
+        if(sharpness > bestSharpness) {
+          bestSharpness = sharpness;
+          bestAngle = angle;
+        }
+      }
+
+      return ItfLocation(location.x(), location.y(), bestAngle, location.length(), location.height(), location.score());
+    }
+
+    int mCellSize;
+    double mMinCoherence;
+    double mMinEnergy;
+    int mMinCells;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_ITF_LOCATOR_H
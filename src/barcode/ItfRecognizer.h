@@ -3,20 +3,32 @@
 
 #include "config.h"
 #include <cassert>
-#include <cstdlib> /* for rand() */
-#include <cmath>   /* for abs() */
+#include <cmath>     /* for abs() */
+#include <algorithm> /* for std::max() */
 #include <vector>
-#include <map>
 #include <boost/noncopyable.hpp>
-#include <boost/tuple/tuple.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <boost/range/algorithm/fill.hpp>
 #include <boost/range/numeric.hpp>
 #include <boost/algorithm/string/predicate.hpp> /* for boost::starts_with and boost::ends_with */
 #include <vigra/stdimage.hxx>
-#include <vigra/splineimageview.hxx>
 #include <arx/Foreach.h>
+#include <arx/Utility.h> /* for unreachable() */
 #include "ItfEncoding.h"
 #include "ItfCode.h"
+#include "CodeVoteTable.h"
+#include "DigitVoteTable.h"
+#include "ItfDecoder.h"
+#include "ItfRecognizerContext.h"
+#include "ItfResult.h"
+#include "ItfSchema.h"
+#include "KMeans.h"
+#include "LineSampler.h"
+#include "ProjectionProfile.h"
+#include "Random.h"
+#include "SubpixelEdges.h"
 
 /**
  * @def DEBUG_BARCODE
@@ -40,36 +52,469 @@ namespace barcode {
   public:
     typedef vigra::BImage::value_type value_type;
 
-    ItfRecognizer(const vigra::BImage& img): mImg(img), mView(srcImageRange(img)) {
-      assert(img.height() >= 5 && img.width() >= 5);
+    /**
+     * Interpolation method used for scanline extraction.
+     */
+    enum Sampler {
+      SPLINE_SAMPLER,   /**< Cubic spline over the prefiltered image. */
+      BILINEAR_SAMPLER, /**< Fixed-point bilinear interpolation over the raw image. */
+      NEAREST_SAMPLER   /**< Fixed-point nearest neighbour sampling of the raw image. */
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param img                      Image that contains the barcode. Must
+     *                                 outlive the recognizer.
+     * @param sampler                  Interpolation method for scanlines.
+     *                                 Spline sampler prefilters the whole 
+     *                                 image on construction, the other 
+     *                                 samplers work on the image directly.
+     */
+    ItfRecognizer(const vigra::BImage& img, Sampler sampler = SPLINE_SAMPLER): 
+      mImg(img), mSampler(sampler), mOwnContext(new ItfRecognizerContext()), mContext(*mOwnContext), mAccumulator(LINE_ACCUMULATOR), mEdgeDetector(BINARY_EDGE_DETECTOR), mDecoder(HARD_DECODER), mVoting(CODE_VOTING), mProfileReady(false), mSeed(0), mThreadCount(1), mStopMargin(0) 
+    {
+      init();
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param img                      Image that contains the barcode. Must
+     *                                 outlive the recognizer.
+     * @param sampler                  Interpolation method for scanlines.
+     * @param context                  Context to keep all the recognition
+     *                                 buffers in. Must outlive the recognizer
+     *                                 and must not be used by another 
+     *                                 recognizer until this one is destroyed.
+     */
+    ItfRecognizer(const vigra::BImage& img, Sampler sampler, ItfRecognizerContext& context): 
+      mImg(img), mSampler(sampler), mContext(context), mAccumulator(LINE_ACCUMULATOR), mEdgeDetector(BINARY_EDGE_DETECTOR), mDecoder(HARD_DECODER), mVoting(CODE_VOTING), mProfileReady(false), mSeed(0), mThreadCount(1), mStopMargin(0) 
+    {
+      init();
+    };
+
+    Sampler sampler() const {
+      return mSampler;
+    }
+
+    /**
+     * Method used to build the accumulated scanline of a trial.
+     */
+    enum Accumulator {
+      LINE_ACCUMULATOR,      /**< Sample each of the randomly chosen lines separately. */
+      PROJECTION_ACCUMULATOR /**< Average a band of parallel lines using column prefix sums. */
+    };
+
+    /**
+     * @param accumulator              Scanline accumulation method. 
+     *                                 Projection accumulator computes prefix
+     *                                 sums for the whole image when set, after
+     *                                 that the cost of a trial doesn't depend
+     *                                 on the number of lines averaged.
+     */
+    void setAccumulator(Accumulator accumulator) {
+      mAccumulator = accumulator;
+
+      if(accumulator == PROJECTION_ACCUMULATOR && !mProfileReady) {
+        mContext.mProfile.assign(mImg);
+        mProfileReady = true;
+      }
+    }
+
+    Accumulator accumulator() const {
+      return mAccumulator;
+    }
+
+    /**
+     * Method used to measure segment widths of an accumulated scanline.
+     */
+    enum EdgeDetector {
+      BINARY_EDGE_DETECTOR,  /**< Binarize the scanline and measure run lengths, retry with median filtering on failure. */
+      SUBPIXEL_EDGE_DETECTOR /**< Locate edges at gradient extrema of the grayscale scanline with sub-sample precision. */
+    };
+
+    void setEdgeDetector(EdgeDetector edgeDetector) {
+      mEdgeDetector = edgeDetector;
+    }
+
+    EdgeDetector edgeDetector() const {
+      return mEdgeDetector;
+    }
+
+    /**
+     * Method used to turn segment widths into digits.
+     */
+    enum Decoder {
+      HARD_DECODER, /**< Classify each segment as narrow or wide, then look up 5-bar groups. */
+      SOFT_DECODER  /**< Find the most likely digit sequence given the measured widths. */
+    };
+
+    void setDecoder(Decoder decoder) {
+      mDecoder = decoder;
+    }
+
+    Decoder decoder() const {
+      return mDecoder;
+    }
+
+    /**
+     * @param codeLength               Number of digits in the barcode, zero
+     *                                 if not known. Trials that produce
+     *                                 segment sequences of other lengths are
+     *                                 rejected.
+     */
+    void setCodeLength(int codeLength) {
+      mSoftDecoder.setCodeLength(codeLength);
+    }
+
+    int codeLength() const {
+      return mSoftDecoder.codeLength();
+    }
+
+    /**
+     * @param checkSum                 Whether the barcode is known to pass
+     *                                 the mod 10 checksum. Trials that
+     *                                 produce barcodes with a wrong checksum
+     *                                 are rejected. Soft decoder uses this 
+     *                                 to correct misread digits.
+     */
+    void setCheckSum(bool checkSum) {
+      mSoftDecoder.setCheckSum(checkSum);
+    }
+
+    bool checkSum() const {
+      return mSoftDecoder.checkSum();
+    }
+
+    /**
+     * @param schema                   Known structure of the barcode. Replaces
+     *                                 code length and checksum settings.
+     *                                 Trials that produce barcodes that don't
+     *                                 match the schema are rejected, and soft
+     *                                 decoder only considers the digits the
+     *                                 schema allows.
+     */
+    void setSchema(const ItfSchema& schema) {
+      mSoftDecoder.setSchema(schema);
+    }
+
+    const ItfSchema& schema() const {
+      return mSoftDecoder.schema();
+    }
+
+    /**
+     * Method used to combine the results of recognition trials.
+     */
+    enum Voting {
+      CODE_VOTING, /**< Count votes for whole barcodes. */
+      DIGIT_VOTING /**< Count votes for each digit position separately. */
     };
 
+    /**
+     * @param voting                   Voting method. With digit voting, 
+     *                                 trials that produced barcodes of the
+     *                                 leading length are combined position by
+     *                                 position, and vote margin is the 
+     *                                 smallest margin among all positions.
+     */
+    void setVoting(Voting voting) {
+      mVoting = voting;
+    }
+
+    Voting voting() const {
+      return mVoting;
+    }
+
+    /**
+     * @param seed                     Seed for the random scanline generator.
+     *                                 Recognition with the same seed always
+     *                                 produces the same result, regardless of
+     *                                 the number of threads used.
+     */
+    void setSeed(unsigned seed) {
+      mSeed = seed;
+    }
+
+    unsigned seed() const {
+      return mSeed;
+    }
+
+    /**
+     * @param threadCount              Number of threads to run recognition
+     *                                 trials on. Zero means the number of
+     *                                 hardware threads.
+     */
+    void setThreadCount(int threadCount) {
+      assert(threadCount >= 0);
+
+      mThreadCount = threadCount;
+    }
+
+    int threadCount() const {
+      return mThreadCount;
+    }
+
+    /**
+     * @param stopMargin               Vote margin for early stopping. 
+     *                                 Recognition stops as soon as the leading
+     *                                 barcode passes the mod 10 checksum and
+     *                                 is this many votes ahead of the 
+     *                                 runner-up, even if the minimal number
+     *                                 of iterations was not performed yet.
+     *                                 Zero disables early stopping.
+     */
+    void setStopMargin(int stopMargin) {
+      assert(stopMargin >= 0);
+
+      mStopMargin = stopMargin;
+    }
+
+    int stopMargin() const {
+      return mStopMargin;
+    }
+
     /**
      * @param minIterations            Minimal number of iterations to perform,
      *                                 even if solution was found on the
      *                                 first iteration.
      * @param maxIterations            Maximal number of iterations to perform.
+     * @returns                        Recognized barcode, or empty barcode if
+     *                                 recognition fails.
      */
     ItfCode operator() (int minIterations, int maxIterations) const {
-      std::map<ItfCode, int> counts;
-      std::vector<value_type> line;
-      std::vector<int> accumulatedLine;
-      std::vector<char> binaryLine;
-      std::vector<int> hystogram;
-      std::vector<int> segments;
-      std::vector<char> binarySegments;
+      return run(minIterations, maxIterations).code();
+    }
+
+    /**
+     * @param minIterations            Minimal number of iterations to perform,
+     *                                 unless stopped early.
+     * @param maxIterations            Maximal number of iterations to perform.
+     * @returns                        Recognition result.
+     */
+    ItfResult run(int minIterations, int maxIterations) const {
+      ItfResult result;
+      run(minIterations, maxIterations, result);
+      return result;
+    }
+
+    /**
+     * @param minIterations            Minimal number of iterations to perform,
+     *                                 unless stopped early.
+     * @param maxIterations            Maximal number of iterations to perform.
+     * @param result[out]              Recognition result. Storage of the 
+     *                                 barcode is reused.
+     */
+    void run(int minIterations, int maxIterations, ItfResult& result) const {
+      if(mVoting == DIGIT_VOTING) {
+        mContext.mDigitVotes.clear(codeLength());
+        run(mContext.mDigitVotes, minIterations, maxIterations, result);
+      } else {
+        mContext.mCodeVotes.clear(std::max(minIterations, maxIterations));
+        run(mContext.mCodeVotes, minIterations, maxIterations, result);
+      }
+    }
+
+  private:
+    typedef ItfRecognizerContext::Buffers Buffers;
+
+    /**
+     * Prepares the context for the image being recognized.
+     */
+    void init() {
+      assert(mImg.height() >= 5 && mImg.width() >= 5);
+
+      if(mSampler == SPLINE_SAMPLER)
+        mContext.mSpline.assign(mImg);
+    }
+
+    /**
+     * Runs recognition trials and counts their votes in the given table.
+     */
+    template<class VoteTable>
+    void run(VoteTable& votes, int minIterations, int maxIterations, ItfResult& result) const {
+      int iterationLimit = std::max(minIterations, maxIterations);
 
 #ifdef DEBUG_BARCODE
-      vigra::BImage debugImage;
+      /* Scanlines are sampled at two points per pixel. */
+      mDebugImage.resize(2 * mImg.width() + 1, iterationLimit * 2, 0);
 #endif
 
-      for(int i = 0; i < minIterations || (i < maxIterations && counts.size() == 0); i++) {
-        accumulatedLine.clear();
+      int i = 0;
+      int threadCount = mThreadCount != 0 ? mThreadCount : std::max(1u, boost::thread::hardware_concurrency());
+      if(static_cast<int>(mContext.mBuffers.size()) < threadCount)
+        mContext.mBuffers.resize(threadCount);
+      if(threadCount == 1) {
+        Buffers& buffers = mContext.mBuffers[0];
+        while(i < minIterations || (i < maxIterations && votes.empty()))
+          if(vote(votes, trial(i++, buffers)))
+            break;
+      } else {
+        /* Trials are run speculatively on the pool, but votes are still 
+         * counted in trial order, so the stopping condition is checked at 
+         * exactly the same points as in single-threaded mode. */
+        TrialPool pool(*this, mContext, iterationLimit, threadCount);
+        while(i < minIterations || (i < maxIterations && votes.empty()))
+          if(vote(votes, pool.result(i++)))
+            break;
+      }
+
+#ifdef DEBUG_BARCODE
+      exportImage(mDebugImage, "DebugBarcode.png");
+#endif
+
+      int leaderCount, margin;
+      votes.leaders(mContext.mLeader, leaderCount, margin);
+      result.assign(mContext.mLeader, i, leaderCount, margin);
+    }
+
+    /**
+     * Pool of threads that run recognition trials ahead of the thread that
+     * counts the votes.
+     */
+    class TrialPool: public boost::noncopyable {
+    public:
+      TrialPool(const ItfRecognizer& recognizer, ItfRecognizerContext& context, int maxIterations, int threadCount): 
+        mRecognizer(recognizer), mContext(context), mResults(context.mResults), mDone(context.mDone), mIterations(maxIterations), mNext(0), mConsumed(0), mLookahead(2 * threadCount), mStopped(false) 
+      {
+        if(static_cast<int>(mResults.size()) < maxIterations)
+          mResults.resize(maxIterations);
+        mDone.assign(maxIterations, false);
+
+        for(int i = 0; i < threadCount; i++)
+          mThreads.create_thread(boost::bind(&TrialPool::work, this, i));
+      }
+
+      ~TrialPool() {
+        {
+          boost::mutex::scoped_lock lock(mMutex);
+          mStopped = true;
+        }
+        mCondition.notify_all();
+        mThreads.join_all();
+      }
+
+      /**
+       * Waits for the given trial to finish.
+       *
+       * @param iteration              Number of the trial.
+       * @returns                      Result of the given trial.
+       */
+      const ItfCode& result(int iteration) {
+        boost::mutex::scoped_lock lock(mMutex);
+        if(mConsumed < iteration) {
+          mConsumed = iteration;
+          mCondition.notify_all();
+        }
+        while(!mDone[iteration])
+          mCondition.wait(lock);
+        return mResults[iteration];
+      }
+
+    private:
+      void work(int index) {
+        Buffers& buffers = mContext.mBuffers[index];
+        while(true) {
+          int iteration;
+          {
+            boost::mutex::scoped_lock lock(mMutex);
+
+            /* Don't run too far ahead of the vote counter, most of these 
+             * trials will be thrown away. */
+            while(!mStopped && mNext >= mConsumed + mLookahead)
+              mCondition.wait(lock);
+            if(mStopped || mNext >= mIterations)
+              return;
+            iteration = mNext++;
+          }
+
+          const ItfCode& code = mRecognizer.trial(iteration, buffers);
+
+          {
+            boost::mutex::scoped_lock lock(mMutex);
+            mResults[iteration] = code;
+            mDone[iteration] = true;
+          }
+          mCondition.notify_all();
+        }
+      }
+
+      const ItfRecognizer& mRecognizer;
+      ItfRecognizerContext& mContext;
+      std::vector<ItfCode>& mResults;
+      std::vector<char>& mDone;
+      int mIterations;
+      int mNext;
+      int mConsumed;
+      int mLookahead;
+      bool mStopped;
+      boost::mutex mMutex;
+      boost::condition_variable mCondition;
+      boost::thread_group mThreads;
+    };
 
-        /* Create accumulated scanline. 
-         * 
-         * The number of lines used increases with iteration number. */
-        unsigned lineCount = random(1, 16 + i / 4);
+    /**
+     * Adds a vote and checks the early stopping condition.
+     *
+     * The stopping rule is a sequential test on the two leading barcodes: 
+     * a walk of their vote difference that reaches the given margin is 
+     * unlikely unless the leader is indeed the most probable outcome of a 
+     * trial. Requiring a valid checksum guards against the case of a 
+     * consistently misread digit pair.
+     *
+     * @param votes[in, out]           Vote table.
+     * @param code                     Result of the trial.
+     * @returns                        Whether recognition can be stopped.
+     */
+    template<class VoteTable>
+    bool vote(VoteTable& votes, const ItfCode& code) const {
+      if(code.size() == 0)
+        return false;
+
+      votes.add(code);
+
+      if(mStopMargin == 0)
+        return false;
+
+      ItfCode& leader = mContext.mLeader;
+      int leaderCount, margin;
+      votes.leaders(leader, leaderCount, margin);
+      return margin >= mStopMargin && leader.size() != 0 && leader.mod10CheckSum() == 0;
+    }
+
+    /**
+     * Performs a single recognition trial.
+     *
+     * @param iteration                Number of the trial. Together with the
+     *                                 seed, defines the scanlines used.
+     * @param buffers                  Scratch buffers.
+     * @returns                        Recognized barcode, or empty barcode if
+     *                                 recognition fails. Stored in the given
+     *                                 buffers.
+     */
+    const ItfCode& trial(int iteration, Buffers& buffers) const {
+      Random random(mSeed, iteration);
+      std::vector<value_type>& line = buffers.line;
+      std::vector<int>& accumulatedLine = buffers.accumulatedLine;
+      std::vector<char>& binaryLine = buffers.binaryLine;
+      std::vector<int>& hystogram = buffers.hystogram;
+
+      /* Create accumulated scanline. 
+       * 
+       * The number of lines used increases with iteration number. */
+      unsigned lineCount = random(1, 16 + iteration / 4);
+      if(mAccumulator == PROJECTION_ACCUMULATOR) {
+        /* Average a band of parallel lines one pixel apart. Band center
+         * is chosen so that the whole band fits into the image. */
+        double bandHeight = std::min<double>(lineCount, mImg.height());
+        double lo = bandHeight / 2, hi = mImg.height() - bandHeight / 2;
+        double y0 = lo + (hi - lo) * random(0, 1024) / 1024;
+        double y1 = lo + (hi - lo) * random(0, 1024) / 1024;
+        double step = 0.5 * (mImg.width() - 1) / mImg.width();
+        line.resize(LineSampler::sampleCount(mImg.width() - 1, step));
+        mContext.mProfile.band(y0, y1, bandHeight, step, line.size(), &line[0]);
+      } else {
+        accumulatedLine.clear();
         for(unsigned j = 0; j < lineCount; j++) {
           vigra::Diff2D lineStart(0, random(0, mImg.height()));
           vigra::Diff2D lineEnd(mImg.width() - 1, random(0, mImg.height()));
@@ -84,96 +529,90 @@ namespace barcode {
         line.resize(accumulatedLine.size());
         for(unsigned k = 0; k < line.size(); k++)
           line[k] = static_cast<value_type>(accumulatedLine[k] / lineCount);
+      }
 
 #ifdef DEBUG_BARCODE
-        /* Draw line on the debug image. */
-        if(debugImage.width() == 0)
-          debugImage.resize(accumulatedLine.size(), maxIterations * 2, 0);
-        for(unsigned x = 0; x < line.size(); x++)
-          debugImage(x, i) = line[x];
+      /* Draw line on the debug image. */
+      for(unsigned x = 0; x < line.size() && x < static_cast<unsigned>(mDebugImage.width()); x++)
+        mDebugImage(x, iteration) = line[x];
 #endif
 
-        /* Crop line. 
-         * 
-         * K-means binarization is currently used for cropping, which is not
-         * so good. If we have printing problems on the sides of barcode, then
-         * everything will fail.
-         * 
-         * We cannot use threshold-based binarization here as the black/white 
-         * pixel count ratio is not known at this point. */
-        cropLine(line);
-
-        ItfCode code;
-
-        /* Try k-means binarization first. */
-        kthBinarize(line, binaryLine);
-        code = recognize(binaryLine, segments, binarySegments);
-
-        /* If k-means binarization failed, then try threshold-based 
-         * binarization. 
-         * 
-         * At this point it is known that black/white pixel count
-         * ratio in the cropped line must equal 0.5. We use slightly larger 
-         * random value as printing problems often result in smaller number of
-         * black pixels. Additional median filtering helps deal with jpeg
-         * ringing and "holes" in black segments. */
-        if(code.size() == 0) {
-          /* Build hystogram and find threshold value. */
-          buildHystogram(line, hystogram, 255);
-          unsigned count = 0, targetCount = line.size() * (50 + random(0, 20)) / 100, median;
-          for(median = 0; median < hystogram.size(); median++) {
-            count += hystogram[median];
-            if(count >= targetCount)
-              break;
-          }
+      KMeans::hystogram(line, hystogram, 255);
+
+      /* Sub-pixel edges are measured on the grayscale line directly, with
+       * the contrast estimated from the k-means centers. Cropping is not 
+       * needed, as everything before the first dark-going edge is 
+       * skipped. */
+      if(mEdgeDetector == SUBPIXEL_EDGE_DETECTOR) {
+        int a, b;
+        kthCenters(line, hystogram, 0.5f, a, b);
+        if(b - a < 2) {
+          buffers.code.clear();
+          return buffers.code;
+        }
 
-          /* Apply threshold binarization. */
-          binaryLine.resize(line.size());
-          for(unsigned j = 0; j < line.size(); j++)
-            binaryLine[j] = line[j] <= median ? 0 : 1;
+        SubpixelEdges::measure(line, b - a, buffers.edges, buffers.segments);
+        return decodeSegments(buffers);
+      }
 
-          /* Apply random-sized median filter. */
-          medianFilter(binaryLine, 3 + 2 * random(0, 3));
+      /* Crop line. 
+       * 
+       * K-means binarization is currently used for cropping, which is not
+       * so good. If we have printing problems on the sides of barcode, then
+       * everything will fail.
+       * 
+       * We cannot use threshold-based binarization here as the black/white 
+       * pixel count ratio is not known at this point. 
+       *
+       * Hystogram is kept up to date with the cropped line, so that it can
+       * be reused below. */
+      cropLine(line, hystogram, binaryLine);
+
+      /* Try k-means binarization first. */
+      kthBinarize(line, hystogram, binaryLine);
+      const ItfCode& code = recognize(binaryLine, buffers);
+
+      /* If k-means binarization failed, then try threshold-based 
+       * binarization. 
+       * 
+       * At this point it is known that black/white pixel count
+       * ratio in the cropped line must equal 0.5. We use slightly larger 
+       * random value as printing problems often result in smaller number of
+       * black pixels. Additional median filtering helps deal with jpeg
+       * ringing and "holes" in black segments. */
+      if(code.size() == 0) {
+        /* Find threshold value. */
+        int median = KMeans::nthElement(hystogram, line.size() * (50 + random(0, 20)) / 100);
+
+        /* Apply threshold binarization. */
+        KMeans::classify(line, binaryLine, median, median + 1);
+
+        /* Apply random-sized median filter. */
+        medianFilter(binaryLine, 3 + 2 * random(0, 3));
 
 #ifdef DEBUG_BARCODE
-          /* Draw binarized line on the debug image. */
-          for(unsigned x = 0; x < binaryLine.size(); x++)
-            debugImage(x, i + maxIterations) = binaryLine[x] * 255;
+        /* Draw binarized line on the debug image. */
+        for(unsigned x = 0; x < binaryLine.size() && x < static_cast<unsigned>(mDebugImage.width()); x++)
+          mDebugImage(x, iteration + mDebugImage.height() / 2) = binaryLine[x] * 255;
 #endif
 
-          code = recognize(binaryLine, segments, binarySegments);
-          if(code.size() == 0)
-            continue;
-        }
-
-        counts[code]++;
+        recognize(binaryLine, buffers);
       }
 
-#ifdef DEBUG_BARCODE
-      exportImage(debugImage, "DebugBarcode.png");
-#endif
-
-      ItfCode result;
-      int maxCount = 0;
-      map_foreach(const ItfCode& code, const int& count, counts)
-        if(count > maxCount)
-          boost::tie(result, maxCount) = boost::make_tuple(code, count);
-      
-      return result;      
+      return code;
     }
 
-  private:
     /**
      * Recognizes barcode.
      * 
      * @param binaryLine[in, out]      Binarized line.
-     * @param segments[out]            Buffer for segments.
-     * @param binarySegments[out]      Buffer for binarized segments.
+     * @param buffers                  Scratch buffers for segments.
      * @returns                        Recognized barcode, or empty barcode if
-     *                                 recognition fails.
+     *                                 recognition fails. Stored in the given
+     *                                 buffers.
      */
-    static ItfCode recognize(std::vector<char> &binaryLine, std::vector<int> &segments, std::vector<char> &binarySegments) {
-      ItfCode result;
+    const ItfCode& recognize(std::vector<char> &binaryLine, Buffers& buffers) const {
+      std::vector<int>& segments = buffers.segments;
 
       /* Build segment sequence. */
       segments.clear();
@@ -194,12 +633,45 @@ namespace barcode {
       if(segments.size() % 2 == 0)
         segments.pop_back(); /* Skip last white segment. */
 
+      return decodeSegments(buffers);
+    }
+
+    /**
+     * Decodes segment widths into a barcode.
+     *
+     * @param buffers                  Scratch buffers. Segment widths are 
+     *                                 read from <tt>buffers.segments</tt>, 
+     *                                 starting with a black bar.
+     * @returns                        Recognized barcode, or empty barcode if
+     *                                 recognition fails. Stored in the given
+     *                                 buffers.
+     */
+    const ItfCode& decodeSegments(Buffers& buffers) const {
+      const std::vector<int>& segments = buffers.segments;
+      std::vector<char>& binarySegments = buffers.binarySegments;
+      ItfCode& result = buffers.code;
+      result.clear();
+
       /* Check length. */
       if(segments.size() % 10 != 7)
         return result;
+      if(codeLength() != 0 && static_cast<int>(segments.size()) != codeLength() / 2 * 10 + 7)
+        return result;
+
+      if(mDecoder == SOFT_DECODER) {
+        mSoftDecoder(segments, result, buffers.confidences, buffers.decoder);
+        if(!schema().accepts(result))
+          result.clear();
+        return result;
+      }
 
-      /* Repeat with median & k-means binarization. */
-      kthBinarize(segments, binarySegments, 3.0f / 5.0f, binaryLine.size()); /* 3/5 of all lines are thin. */
+      /* Repeat with median & k-means binarization. There are only a few
+       * dozens of segments, but their widths may span the whole line, so 
+       * k-means is run in the value domain here. */
+      int kth = KMeans::nthValue(segments, segments.size() * 3 / 5, buffers.sortedSegments); /* 3/5 of all lines are thin. */
+      int a = kth - 1, b = kth + 1;
+      KMeans::valueCenters(segments, a, b);
+      KMeans::classify(segments, binarySegments, a, b);
 
       /* Check head & tail. 
         *
@@ -220,7 +692,6 @@ namespace barcode {
         return result;
 
       /* Build solution. */
-      ItfCode code;
       for(std::size_t i = 4; i + 9 < binarySegments.size(); i += 10) {
         int a = decode(inverted, binarySegments.begin() + i);
         int b = decode(inverted, binarySegments.begin() + i + 1);
@@ -232,6 +703,8 @@ namespace barcode {
         result.addDigit(b);
       }
 
+      if(!schema().accepts(result))
+        result.clear();
       return result;
     }
 
@@ -279,40 +752,37 @@ namespace barcode {
     }
 
     /**
-     * @returns                        Random number in range [lo, hi).
-     */
-    static int random(int lo, int hi) {
-      /* On gcc RAND_MAX == INT_MAX, so we need to cast it to long long. */
-      return static_cast<int>(lo + static_cast<long long>(hi - lo) * rand() / (static_cast<long long>(RAND_MAX) + 1));
-    }
-
-    template<class T>
-    static void kthBinarize(const std::vector<T> &line, std::vector<char> &binaryLine, float k = 0.5f) {
-      kthBinarize(line, binaryLine, k, (1 << (8 * sizeof(T))) - 1);
-    }
-
-    /**
-     * Performs k-means binarization of the given set of values.
+     * Performs k-means binarization of the given line.
      *
      * Centers of 0- and 1-clusters will be initialized with values that
-     * are equally-spaced from n-th order statistic of the given set of values,
-     * where n equals the size of the given set of values times k.
+     * are equally-spaced from n-th order statistic of the given line,
+     * where n equals the size of the line times k. All k-means iterations
+     * are performed on the hystogram.
      *
-     * @param values                   Set of values to binarize.
-     * @param[out] binaryValues        Output binary mask.
+     * @param line                     Line to binarize.
+     * @param hystogram                Hystogram of the line.
+     * @param[out] binaryLine          Output binary mask.
      * @param k                        Value in range [0, 1] that determines
      *                                 the initial centers of 0- and 1-clusters.
-     * @param maxValue                 Maximal value of a set element.
      */
-    template<class T>
-    static void kthBinarize(const std::vector<T> &values, std::vector<char> &binaryValues, float k, int maxValue) {
-      assert(k >= 0 && k <= 1);
+    static void kthBinarize(const std::vector<value_type> &line, const std::vector<int> &hystogram, std::vector<char> &binaryLine, float k = 0.5f) {
+      int a, b;
+      kthCenters(line, hystogram, k, a, b);
+      KMeans::classify(line, binaryLine, a, b);
+    }
 
-      std::vector<int> hystogram;
+    /**
+     * Finds k-means cluster centers of the given line.
+     *
+     * @see kthBinarize()
+     */
+    static void kthCenters(const std::vector<value_type> &line, const std::vector<int> &hystogram, float k, int& a, int& b) {
+      assert(k >= 0 && k <= 1);
 
-      buildHystogram(values, hystogram, maxValue);
-      int kth = nthElement(hystogram, static_cast<int>(values.size() * k));
-      binarize(values, binaryValues, kth - 1, kth + 1);
+      int kth = KMeans::nthElement(hystogram, static_cast<int>(line.size() * k));
+      a = kth - 1;
+      b = kth + 1;
+      KMeans::centers(hystogram, a, b);
     }
 
     /**
@@ -321,10 +791,12 @@ namespace barcode {
      * in the binary cluster.
      *
      * @param line[in, out]            Colored segment.
+     * @param hystogram[in, out]       Hystogram of the colored segment. Cropped
+     *                                 values are subtracted from it.
+     * @param binaryLine               Scratch buffer.
      */
-    void cropLine(std::vector<value_type> &line) const {
-      std::vector<char> binaryLine;
-      kthBinarize(line, binaryLine);
+    static void cropLine(std::vector<value_type> &line, std::vector<int> &hystogram, std::vector<char> &binaryLine) {
+      kthBinarize(line, hystogram, binaryLine);
 
       /* Crop line. */
       std::size_t lCrop = 0;
@@ -336,7 +808,12 @@ namespace barcode {
 
       if(lCrop + rCrop >= line.size()) {
         line.clear();
+        boost::fill(hystogram, 0);
       } else {
+        for(std::size_t i = line.size() - rCrop - 1; i < line.size(); i++)
+          hystogram[line[i]]--;
+        for(std::size_t i = 0; i < lCrop; i++)
+          hystogram[line[i]]--;
         line.erase(line.end() - rCrop - 1, line.end());
         line.erase(line.begin(), line.begin() + lCrop);
       }
@@ -348,97 +825,32 @@ namespace barcode {
      * @param out[out]                 Vector to write the segment color 
      *                                 information to.
      * @param v0                       Coordinate of the start of the segment.
-     * @param v0                       Coordinate of the end of the segment.
+     * @param v1                       Coordinate of the end of the segment.
      * @param step                     Number of image pixels per segment pixel.
      */
     void scanLine(std::vector<value_type>& out, vigra::Diff2D v0, vigra::Diff2D v1, double step) const {
       assert(mImg.isInside(v0) && mImg.isInside(v1));
 
-      out.clear();
       double length = (v1 - v0).magnitude();
-      double dx = (v1.x - v0.x) / length;
-      double dy = (v1.y - v0.y) / length;
-      
-      double x0 = v0.x, y0 = v0.y;
-      double t = 0;
-      do {
-        out.push_back(mView(x0 + dx * t, y0 + dy * t));
-        t += step;
-      } while(t < length);
-    }
-
-    /**
-     * Binarizes the given set of values using k-means binarization.
-     *
-     * @param values                   Set of values to binarize.
-     * @param out[out]                 Output binary mask.
-     * @param a                        Initial center of 0-cluster.
-     * @param b                        Initial center of 1-cluster.
-     */
-    template<class T>
-    static void binarize(const std::vector<T>& values, std::vector<char>& out, int a, int b) {
-      out.resize(values.size());
-
-      /* Adjust means. */
-      while(true) {
-        assert(b >= a);
-
-        int aNew = 0, bNew = 0, bCount = 0, aCount = 0;
-        foreach(T value, values) {
-          if(b - value < value - a) {
-            bCount++;
-            bNew += value;
-          } else {
-            aCount++;
-            aNew += value;
-          }
-        }
-        aNew = aCount != 0 ? aNew / aCount : a;
-        bNew = bCount != 0 ? bNew / bCount : b;
-
-        if(std::abs(a - aNew) < 1 && std::abs(b - bNew) < 1)
-          break;
-        
-        a = aNew;
-        b = bNew;
+      int count = LineSampler::sampleCount(length, step);
+      double dx = step * (v1.x - v0.x) / length;
+      double dy = step * (v1.y - v0.y) / length;
+      out.resize(count);
+
+      switch(mSampler) {
+      case SPLINE_SAMPLER:
+        for(int i = 0; i < count; i++)
+          out[i] = mContext.mSpline(v0.x + dx * i, v0.y + dy * i);
+        break;
+      case BILINEAR_SAMPLER:
+        LineSampler::bilinear(mImg, v0.x, v0.y, dx, dy, count, &out[0]);
+        break;
+      case NEAREST_SAMPLER:
+        LineSampler::nearest(mImg, v0.x, v0.y, dx, dy, count, &out[0]);
+        break;
+      default:
+        unreachable();
       }
-      
-      /* Classify. */
-      for(std::size_t i = 0; i < values.size(); i++)
-        out[i] = (b - values[i] < values[i] - a) ? 1 : 0;
-    }
-
-    /**
-     * Constructs a hystogram for the given set of values.
-     *
-     * @param values                   Set of values to constryct hystogram for.
-     * @param out[out]                 Hystogram.
-     * @param maxValue                 Maximal value of a set element.
-     */
-    template<class T>
-    static void buildHystogram(const std::vector<T>& values, std::vector<int>& out, int maxValue) {
-      out.resize(maxValue + 1);
-      
-      boost::fill(out, 0);
-      foreach(T value, values)
-        out[value]++;
-    }
-
-    /**
-     * Finds nth smallest element in a set given its hystogram.
-     *
-     * @param hystogram                Hystogram of a set.
-     * @param n                        Number of the smallest element to find.
-     * @returns                        Nth smallest element.
-     */
-    static int nthElement(std::vector<int>& hystogram, int n) {
-      int sum = 0;
-      std::size_t element;
-      for(element = 0; element < hystogram.size(); element++)
-        if((sum += hystogram[element]) >= n)
-          return element;
-      
-      unreachable();
     }
 
     /**
@@ -457,7 +869,22 @@ namespace barcode {
     }
 
     const vigra::BImage& mImg;
-    const vigra::SplineImageView<3, value_type> mView;
+    const Sampler mSampler;
+    boost::scoped_ptr<ItfRecognizerContext> mOwnContext;
+    ItfRecognizerContext& mContext;
+    Accumulator mAccumulator;
+    EdgeDetector mEdgeDetector;
+    Decoder mDecoder;
+    ItfDecoder mSoftDecoder;
+    Voting mVoting;
+    bool mProfileReady;
+    unsigned mSeed;
+    int mThreadCount;
+    int mStopMargin;
+
+#ifdef DEBUG_BARCODE
+    mutable vigra::BImage mDebugImage;
+#endif
   };
 
 } // namespace barcode
@@ -0,0 +1,82 @@
+#ifndef BARCODE_ITF_RECOGNIZER_CONTEXT_H
+#define BARCODE_ITF_RECOGNIZER_CONTEXT_H
+
+#include "config.h"
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <vigra/stdimage.hxx>
+#include "CodeVoteTable.h"
+#include "CubicSplineImage.h"
+#include "DigitVoteTable.h"
+#include "ItfCode.h"
+#include "ItfDecoder.h"
+#include "ProjectionProfile.h"
+#include "SubpixelEdges.h"
+
+namespace barcode {
+  class ItfRecognizer;
+
+// -------------------------------------------------------------------------- //
+// ItfRecognizerContext
+// -------------------------------------------------------------------------- //
+  /**
+   * Storage for everything an ItfRecognizer needs during recognition: spline
+   * coefficients, prefix sums, per-thread scratch buffers and vote tables.
+   *
+   * A recognizer constructed without a context allocates all of this anew.
+   * Recognizers that share a long-lived context reuse its storage instead,
+   * so once the buffers have grown to the largest barcode image seen,
+   * single-threaded recognition doesn't allocate. Multi-threaded recognition
+   * still starts its worker threads for each run.
+   *
+   * A context must not be used by two recognizers at the same time.
+   */
+  class ItfRecognizerContext: public boost::noncopyable {
+  public:
+    typedef vigra::BImage::value_type value_type;
+
+    /**
+     * Scratch buffers for a single thread of recognition trials.
+     */
+    struct Buffers {
+      std::vector<value_type> line;
+      std::vector<int> accumulatedLine;
+      std::vector<char> binaryLine;
+      std::vector<int> hystogram;
+      std::vector<int> segments;
+      std::vector<int> sortedSegments;
+      std::vector<char> binarySegments;
+      std::vector<SubpixelEdges::Edge> edges;
+      std::vector<double> confidences;
+      ItfDecoder::Buffers decoder;
+      ItfCode code;
+    };
+
+    ItfRecognizerContext() {}
+
+    /**
+     * @returns                        Scratch image for callers that need to
+     *                                 copy the barcode out of a larger image
+     *                                 before recognition.
+     */
+    vigra::BImage& image() {
+      return mImage;
+    }
+
+  private:
+    friend class ItfRecognizer;
+
+    CubicSplineImage mSpline;
+    ProjectionProfile mProfile;
+    std::vector<Buffers> mBuffers;
+    std::vector<ItfCode> mResults;
+    std::vector<char> mDone;
+    CodeVoteTable mCodeVotes;
+    DigitVoteTable mDigitVotes;
+    ItfCode mLeader;
+    vigra::BImage mImage;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_ITF_RECOGNIZER_CONTEXT_H
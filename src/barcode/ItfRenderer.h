@@ -0,0 +1,158 @@
+#ifndef BARCODE_ITF_RENDERER_H
+#define BARCODE_ITF_RENDERER_H
+
+#include "config.h"
+#include <cassert>
+#include <algorithm> /* for std::max() */
+#include <vector>
+#include <boost/array.hpp>
+#include <vigra/stdimage.hxx>
+#include <vigra/basicimageview.hxx>
+#include <vigra/resizeimage.hxx>
+#include <arx/Foreach.h>
+#include "DigitImages.h"
+#include "ItfBar.h"
+#include "ItfCode.h"
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// ItfRenderer
+// -------------------------------------------------------------------------- //
+  /**
+   * Renders Interleaved 2 of 5 barcode images with a fixed geometry.
+   *
+   * Label digits are scaled to the label height once, in the constructor,
+   * so rendering a batch of barcodes with a single renderer doesn't resize
+   * anything. Barcodes can be rendered into images of their own, or into
+   * a region of a larger image, e.g. a sheet of tiled barcodes.
+   */
+  class ItfRenderer {
+  public:
+    /**
+     * Constructor.
+     *
+     * @param barWidth                 Width in pixels of a single narrow bar.
+     * @param barHeight                Height of bar area in pixels.
+     * @param midSpace                 Height of empty area between barcode
+     *                                 and label in pixels.
+     * @param labelHeight              Height of label in pixels. Labels lower
+     *                                 than two pixels are not drawn.
+     * @param inverted                 Whether to swap narrow and wide bars, as
+     *                                 the old buggy generator did. See the
+     *                                 note in ItfEncoding.
+     */
+    ItfRenderer(int barWidth, int barHeight, int midSpace, int labelHeight, bool inverted = false):
+      mBarWidth(barWidth), mBarHeight(barHeight), mMidSpace(midSpace), mLabelHeight(labelHeight), mInverted(inverted)
+    {
+      assert(barWidth > 0 && barHeight > 0 && midSpace >= 0 && labelHeight >= 0);
+
+      if(mLabelHeight < 2) {
+        mLabelHeight = 0;
+        mMidSpace = 0;
+      }
+
+      if(mLabelHeight != 0) {
+        for(int digit = 0; digit < 10; digit++) {
+          const vigra::BImage& digitImage = DigitImages::image(digit);
+          mGlyphs[digit].resize(digitImage.width() * mLabelHeight / digitImage.height(), mLabelHeight);
+          resizeImageLinearInterpolation(srcImageRange(digitImage), destImageRange(mGlyphs[digit]));
+        }
+      }
+    }
+
+    /**
+     * @param code                     Barcode.
+     * @returns                        Size of the image of the given barcode.
+     */
+    vigra::Size2D size(const ItfCode& code) const {
+      return vigra::Size2D(std::max(labelWidth(code), barCodeWidth(code)), mBarHeight + mMidSpace + mLabelHeight);
+    }
+
+    /**
+     * Renders barcode into an image of its own.
+     *
+     * @param code                     Barcode, must have even length.
+     * @param[out] img                 Image to render into, resized to the
+     *                                 size of the barcode.
+     */
+    void render(const ItfCode& code, vigra::BImage& img) {
+      img.resize(size(code));
+      render(code, img, vigra::Point2D(0, 0));
+    }
+
+    /**
+     * Renders barcode into a region of the given image. Region is cleared
+     * to white first.
+     *
+     * @param code                     Barcode, must have even length.
+     * @param[in, out] img             Image to render into.
+     * @param origin                   Upper left corner of the region. Region
+     *                                 of size(code) starting at this point
+     *                                 must lie inside the image.
+     */
+    void render(const ItfCode& code, vigra::BImage& img, const vigra::Point2D& origin) {
+      assert(code.size() % 2 == 0);
+
+      vigra::Size2D size = this->size(code);
+      assert(origin.x >= 0 && origin.y >= 0 && origin.x + size.width() <= img.width() && origin.y + size.height() <= img.height());
+      vigra::BasicImageView<vigra::UInt8>(&img[origin.y][origin.x], size, img.width()).init(255);
+
+      /* Draw bars. */
+      code.bars(mBars);
+      int x = origin.x + (size.width() - barCodeWidth(code)) / 2 + mBarWidth * sideSkip();
+      foreach(const ItfBar& bar, mBars) {
+        int w = barWidth(bar);
+        if(bar.isBlack())
+          vigra::BasicImageView<vigra::UInt8>(&img[origin.y][x], vigra::Size2D(w, mBarHeight), img.width()).init(0);
+        x += w;
+      }
+
+      /* Draw label if needed. */
+      if(mLabelHeight == 0)
+        return;
+
+      x = origin.x + (size.width() - labelWidth(code)) / 2;
+      for(int i = 0; i < code.size(); i++) {
+        const vigra::BImage& glyph = mGlyphs[code[i]];
+        copyImage(srcImageRange(glyph), destImage(img, vigra::Point2D(x, origin.y + mBarHeight + mMidSpace)));
+        x += glyph.width();
+      }
+    }
+
+  private:
+    int barWidth(const ItfBar& bar) const {
+      return mBarWidth * ((bar.isThick() != mInverted) ? 3 : 1);
+    }
+
+    int barCodeWidth(const ItfCode& code) const {
+      /* Head is four thin bars, tail is one thick and three thin bars, and
+       * each digit is encoded with three thin and two thick bars. The old
+       * ItfCode::createImage counted the tail as two thin and two thick bars,
+       * so two more narrow bars of white space are added after it to keep
+       * the image size the same. */
+      int thinBars = 4 + 3 + code.size() * 3, thickBars = 1 + code.size() * 2;
+      if(mInverted)
+        std::swap(thinBars, thickBars);
+      return mBarWidth * (sideSkip() * 2 + thinBars + thickBars * 3 + 2);
+    }
+
+    int labelWidth(const ItfCode& code) const {
+      return mLabelHeight == 0 ? 0 : code.size() * mGlyphs[0].width();
+    }
+
+    static int sideSkip() {
+      return 10;
+    }
+
+    int mBarWidth;
+    int mBarHeight;
+    int mMidSpace;
+    int mLabelHeight;
+    bool mInverted;
+    boost::array<vigra::BImage, 10> mGlyphs;
+    std::vector<ItfBar> mBars;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_ITF_RENDERER_H
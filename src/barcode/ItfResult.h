@@ -0,0 +1,98 @@
+#ifndef BARCODE_ITF_RESULT_H
+#define BARCODE_ITF_RESULT_H
+
+#include "config.h"
+#include "ItfCode.h"
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// ItfResult
+// -------------------------------------------------------------------------- //
+  /**
+   * Result of Interleaved 2 of 5 code recognition.
+   */
+  class ItfResult {
+  public:
+    /**
+     * Default constructor.
+     *
+     * Constructs empty result.
+     */
+    ItfResult(): mTrials(0), mVotes(0), mMargin(0) {}
+
+    /**
+     * Constructor.
+     *
+     * @param code                     Recognized barcode.
+     * @param trials                   Number of recognition trials performed.
+     * @param votes                    Number of trials that voted for the
+     *                                 recognized barcode.
+     * @param margin                   Difference between the number of votes
+     *                                 for the recognized barcode and for the
+     *                                 runner-up.
+     */
+    ItfResult(const ItfCode& code, int trials, int votes, int margin):
+      mCode(code), mTrials(trials), mVotes(votes), mMargin(margin) {}
+
+    /**
+     * Replaces the contents of this result. Unlike assignment from a
+     * temporary, reuses the storage of the barcode.
+     *
+     * @see ItfResult(const ItfCode&, int, int, int)
+     */
+    void assign(const ItfCode& code, int trials, int votes, int margin) {
+      mCode = code;
+      mTrials = trials;
+      mVotes = votes;
+      mMargin = margin;
+    }
+
+    /**
+     * @returns                        Recognized barcode, or empty barcode if
+     *                                 recognition has failed.
+     */
+    const ItfCode& code() const {
+      return mCode;
+    }
+
+    /**
+     * @returns                        Number of recognition trials performed.
+     */
+    int trials() const {
+      return mTrials;
+    }
+
+    /**
+     * @returns                        Number of trials that voted for the
+     *                                 recognized barcode.
+     */
+    int votes() const {
+      return mVotes;
+    }
+
+    /**
+     * @returns                        Vote margin between the recognized
+     *                                 barcode and the runner-up.
+     */
+    int margin() const {
+      return mMargin;
+    }
+
+    /**
+     * @returns                        Fraction of trials that voted for the
+     *                                 recognized barcode, in range [0, 1].
+     */
+    double confidence() const {
+      return mTrials == 0 ? 0.0 : static_cast<double>(mVotes) / mTrials;
+    }
+
+  private:
+    ItfCode mCode;
+    int mTrials;
+    int mVotes;
+    int mMargin;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_ITF_RESULT_H
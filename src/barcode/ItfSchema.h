@@ -0,0 +1,206 @@
+#ifndef BARCODE_ITF_SCHEMA_H
+#define BARCODE_ITF_SCHEMA_H
+
+#include "config.h"
+#include <cassert>
+#include <string>
+#include <boost/array.hpp>
+#include "ItfCode.h"
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// ItfSchema
+// -------------------------------------------------------------------------- //
+  /**
+   * Known structure of the barcodes being recognized.
+   *
+   * Schema consists of the barcode length, a set of allowed digits for each
+   * position, numeric fields with allowed value ranges, and a checksum flag.
+   * Recognizer rejects trials that produce barcodes that don't match the
+   * schema, and soft decoder never considers digits that are not allowed at
+   * their positions.
+   *
+   * Schema has fixed capacity, so copying it doesn't allocate.
+   */
+  class ItfSchema {
+  public:
+    enum {
+      MAX_LENGTH = 128,   /**< Maximal position a constraint can be placed on, plus one. */
+      MAX_FIELDS = 16     /**< Maximal number of numeric fields. */
+    };
+
+    /**
+     * Default constructor.
+     *
+     * Constructs a schema that accepts barcodes of any length and doesn't
+     * check the checksum.
+     */
+    ItfSchema(): mLength(0), mCheckSum(false), mFieldCount(0), mConstrainedLength(0) {
+      mMasks.assign(ALL_DIGITS);
+    }
+
+    /**
+     * @param length                   Number of digits in a barcode, zero
+     *                                 to accept barcodes of any length.
+     */
+    void setLength(int length) {
+      assert(length >= 0 && length % 2 == 0);
+
+      mLength = length;
+    }
+
+    int length() const {
+      return mLength;
+    }
+
+    /**
+     * @param checkSum                 Whether barcodes must pass the mod 10
+     *                                 checksum.
+     */
+    void setCheckSum(bool checkSum) {
+      mCheckSum = checkSum;
+    }
+
+    bool checkSum() const {
+      return mCheckSum;
+    }
+
+    /**
+     * Restricts the digits allowed at the given position.
+     *
+     * @param position                 Position in the barcode.
+     * @param digits                   Allowed digits, as a string of digit
+     *                                 characters.
+     */
+    void allowDigits(int position, const std::string& digits) {
+      unsigned mask = 0;
+      for(std::size_t i = 0; i < digits.size(); i++) {
+        assert(digits[i] >= '0' && digits[i] <= '9');
+        mask |= 1u << (digits[i] - '0');
+      }
+      restrict(position, mask);
+    }
+
+    /**
+     * Requires barcodes to start with the given digits.
+     *
+     * @param prefix                   Prefix, as a string of digit characters.
+     */
+    void setPrefix(const std::string& prefix) {
+      for(std::size_t i = 0; i < prefix.size(); i++)
+        allowDigits(static_cast<int>(i), prefix.substr(i, 1));
+    }
+
+    /**
+     * Adds a numeric field. Digits of the field, read as a decimal number,
+     * must lie in the given range. Leading digit of the field is also
+     * restricted, so that soft decoder can make use of the range.
+     *
+     * @param position                 Position of the first digit of the
+     *                                 field.
+     * @param size                     Number of digits in the field, at most
+     *                                 nine.
+     * @param minValue                 Minimal allowed value.
+     * @param maxValue                 Maximal allowed value.
+     */
+    void addField(int position, int size, int minValue, int maxValue) {
+      assert(size > 0 && size <= 9 && position >= 0 && position + size <= MAX_LENGTH);
+      assert(minValue >= 0 && minValue <= maxValue);
+      assert(mFieldCount < MAX_FIELDS);
+
+      Field& field = mFields[mFieldCount++];
+      field.position = position;
+      field.size = size;
+      field.minValue = minValue;
+      field.maxValue = maxValue;
+
+      int scale = 1;
+      for(int i = 1; i < size; i++)
+        scale *= 10;
+      unsigned mask = 0;
+      for(int digit = minValue / scale; digit <= maxValue / scale && digit < 10; digit++)
+        mask |= 1u << digit;
+      restrict(position, mask);
+    }
+
+    /**
+     * @returns                        Whether the given digit is allowed at the
+     *                                 given position.
+     */
+    bool isAllowed(int position, int digit) const {
+      assert(digit >= 0 && digit < 10);
+
+      return position >= MAX_LENGTH || (mMasks[position] & (1u << digit)) != 0;
+    }
+
+    /**
+     * @returns                        Whether digits at some positions are
+     *                                 restricted.
+     */
+    bool hasDigitConstraints() const {
+      return mConstrainedLength != 0;
+    }
+
+    /**
+     * @param code                     Barcode to check.
+     * @returns                        Whether the given barcode matches this
+     *                                 schema.
+     */
+    bool accepts(const ItfCode& code) const {
+      if(mLength != 0 && code.size() != mLength)
+        return false;
+
+      /* A barcode shorter than the constrained positions can't have all
+       * the required digits. */
+      if(code.size() < mConstrainedLength)
+        return false;
+      for(int i = 0; i < mConstrainedLength; i++)
+        if(!isAllowed(i, code[i]))
+          return false;
+
+      for(int i = 0; i < mFieldCount; i++) {
+        const Field& field = mFields[i];
+        if(field.position + field.size > code.size())
+          return false;
+
+        int value = 0;
+        for(int j = 0; j < field.size; j++)
+          value = value * 10 + code[field.position + j];
+        if(value < field.minValue || value > field.maxValue)
+          return false;
+      }
+
+      return !mCheckSum || code.mod10CheckSum() == 0;
+    }
+
+  private:
+    enum {
+      ALL_DIGITS = 0x3FF
+    };
+
+    struct Field {
+      int position;
+      int size;
+      int minValue;
+      int maxValue;
+    };
+
+    void restrict(int position, unsigned mask) {
+      assert(position >= 0 && position < MAX_LENGTH);
+
+      mMasks[position] &= mask;
+      if(mConstrainedLength <= position)
+        mConstrainedLength = position + 1;
+    }
+
+    int mLength;
+    bool mCheckSum;
+    boost::array<unsigned short, MAX_LENGTH> mMasks;
+    boost::array<Field, MAX_FIELDS> mFields;
+    int mFieldCount;
+    int mConstrainedLength;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_ITF_SCHEMA_H
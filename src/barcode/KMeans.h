@@ -0,0 +1,189 @@
+#ifndef BARCODE_K_MEANS_H
+#define BARCODE_K_MEANS_H
+
+#include "config.h"
+#include <cassert>
+#include <cmath>     /* for abs() */
+#include <algorithm> /* for std::nth_element() */
+#include <vector>
+#include <boost/range/algorithm/fill.hpp>
+#include <arx/Foreach.h>
+#include <arx/Utility.h> /* for unreachable() */
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// KMeans
+// -------------------------------------------------------------------------- //
+  /**
+   * Two-cluster k-means kernels for 1-dimensional data.
+   *
+   * For 8-bit data all the iterations are performed on the hystogram, so
+   * that the cost of an iteration is proportional to the number of bins,
+   * not to the number of values. Small sets of values with a wide range
+   * are better handled in the value domain.
+   *
+   * A value is assigned to the 1-cluster if it is strictly closer to its
+   * center, i.e. if <tt>b - value < value - a</tt>, which is equivalent to
+   * <tt>2 * value > a + b</tt>.
+   */
+  class KMeans {
+  public:
+    /**
+     * Constructs a hystogram for the given set of values.
+     *
+     * @param values                   Set of values to construct hystogram for.
+     * @param out[out]                 Hystogram.
+     * @param maxValue                 Maximal value of a set element.
+     */
+    template<class T>
+    static void hystogram(const std::vector<T>& values, std::vector<int>& out, int maxValue) {
+      out.resize(maxValue + 1);
+
+      boost::fill(out, 0);
+      foreach(T value, values)
+        out[value]++;
+    }
+
+    /**
+     * Finds nth smallest element in a set given its hystogram.
+     *
+     * @param hystogram                Hystogram of a set.
+     * @param n                        Number of the smallest element to find.
+     * @returns                        Nth smallest element.
+     */
+    static int nthElement(const std::vector<int>& hystogram, int n) {
+      int sum = 0;
+      for(std::size_t element = 0; element < hystogram.size(); element++)
+        if((sum += hystogram[element]) >= n)
+          return element;
+
+      unreachable();
+      return -1;
+    }
+
+    /**
+     * Finds nth smallest element in a set of values.
+     *
+     * @param values                   Set of values.
+     * @param n                        Number of the smallest element to find,
+     *                                 one-based.
+     * @param scratch                  Scratch buffer.
+     * @returns                        Nth smallest element.
+     */
+    template<class T>
+    static T nthValue(const std::vector<T>& values, int n, std::vector<T>& scratch) {
+      assert(values.size() > 0);
+
+      scratch.assign(values.begin(), values.end());
+      std::size_t index = static_cast<std::size_t>(std::max(n, 1) - 1);
+      std::nth_element(scratch.begin(), scratch.begin() + index, scratch.end());
+      return scratch[index];
+    }
+
+    /**
+     * Finds first and last non-empty bins of a hystogram.
+     *
+     * @param hystogram                Hystogram.
+     * @param lo[out]                  First non-empty bin.
+     * @param hi[out]                  Last non-empty bin.
+     */
+    static void range(const std::vector<int>& hystogram, int& lo, int& hi) {
+      lo = 0;
+      hi = static_cast<int>(hystogram.size()) - 1;
+      while(lo < hi && hystogram[lo] == 0)
+        lo++;
+      while(hi > lo && hystogram[hi] == 0)
+        hi--;
+    }
+
+    /**
+     * Adjusts cluster centers until convergence, iterating over the
+     * hystogram bins.
+     *
+     * @param hystogram                Hystogram of a set.
+     * @param a[in, out]               Center of 0-cluster.
+     * @param b[in, out]               Center of 1-cluster.
+     */
+    static void centers(const std::vector<int>& hystogram, int& a, int& b) {
+      while(true) {
+        assert(b >= a);
+
+        long long aSum = 0, bSum = 0;
+        int aCount = 0, bCount = 0;
+        int size = static_cast<int>(hystogram.size());
+        int split = std::min(std::max((a + b) / 2 + 1, 0), size); /* First bin with 2 * value > a + b. */
+        for(int value = 0; value < split; value++) {
+          aCount += hystogram[value];
+          aSum += static_cast<long long>(hystogram[value]) * value;
+        }
+        for(int value = split; value < size; value++) {
+          bCount += hystogram[value];
+          bSum += static_cast<long long>(hystogram[value]) * value;
+        }
+
+        int aNew = aCount != 0 ? static_cast<int>(aSum / aCount) : a;
+        int bNew = bCount != 0 ? static_cast<int>(bSum / bCount) : b;
+
+        if(std::abs(a - aNew) < 1 && std::abs(b - bNew) < 1)
+          break;
+
+        a = aNew;
+        b = bNew;
+      }
+    }
+
+    /**
+     * Adjusts cluster centers until convergence, iterating over the values.
+     *
+     * @param values                   Set of values.
+     * @param a[in, out]               Center of 0-cluster.
+     * @param b[in, out]               Center of 1-cluster.
+     */
+    template<class T>
+    static void valueCenters(const std::vector<T>& values, int& a, int& b) {
+      while(true) {
+        assert(b >= a);
+
+        int aNew = 0, bNew = 0, bCount = 0, aCount = 0;
+        foreach(T value, values) {
+          if(b - value < value - a) {
+            bCount++;
+            bNew += value;
+          } else {
+            aCount++;
+            aNew += value;
+          }
+        }
+        aNew = aCount != 0 ? aNew / aCount : a;
+        bNew = bCount != 0 ? bNew / bCount : b;
+
+        if(std::abs(a - aNew) < 1 && std::abs(b - bNew) < 1)
+          break;
+
+        a = aNew;
+        b = bNew;
+      }
+    }
+
+    /**
+     * Assigns values to clusters with the given centers.
+     *
+     * @param values                   Set of values to classify.
+     * @param out[out]                 Output binary mask.
+     * @param a                        Center of 0-cluster.
+     * @param b                        Center of 1-cluster.
+     */
+    template<class T>
+    static void classify(const std::vector<T>& values, std::vector<char>& out, int a, int b) {
+      out.resize(values.size());
+
+      const int threshold = a + b;
+      const std::size_t size = values.size();
+      for(std::size_t i = 0; i < size; i++)
+        out[i] = 2 * static_cast<int>(values[i]) > threshold;
+    }
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_K_MEANS_H
@@ -0,0 +1,97 @@
+#ifndef BARCODE_LINE_SAMPLER_H
+#define BARCODE_LINE_SAMPLER_H
+
+#include "config.h"
+#include <cassert>
+#include <cmath>
+#include <algorithm> /* for std::min() and std::max() */
+#include <vigra/stdimage.hxx>
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// LineSampler
+// -------------------------------------------------------------------------- //
+  /**
+   * Samples straight lines of an 8-bit image with fixed-point stepping.
+   *
+   * Coordinates are kept in 16.16 fixed point, and interpolation weights
+   * are 8-bit, so inner loops contain integer arithmetic only. Output is
+   * written into a caller-provided buffer.
+   */
+  class LineSampler {
+  public:
+    typedef vigra::BImage::value_type value_type;
+
+    /**
+     * @param length                   Length of the line, in pixels.
+     * @param step                     Distance between consecutive samples,
+     *                                 in pixels.
+     * @returns                        Number of samples that will be taken
+     *                                 from a line of the given length.
+     */
+    static int sampleCount(double length, double step) {
+      assert(step > 0);
+
+      return std::max(1, static_cast<int>(std::ceil(length / step)));
+    }
+
+    /**
+     * Samples a line using bilinear interpolation.
+     *
+     * @param img                      Image to sample.
+     * @param x0                       X coordinate of the line start.
+     * @param y0                       Y coordinate of the line start.
+     * @param dx                       X increment per sample.
+     * @param dy                       Y increment per sample.
+     * @param count                    Number of samples to take.
+     * @param out[out]                 Output buffer, must have room for
+     *                                 count elements.
+     */
+    static void bilinear(const vigra::BImage& img, double x0, double y0, double dx, double dy, int count, value_type* out) {
+      /* Keep integer parts at least one pixel away from the right and
+       * bottom borders, so that the 2x2 neighbourhood is always inside. */
+      const int maxX = ((img.width() - 1) << 16) - 1;
+      const int maxY = ((img.height() - 1) << 16) - 1;
+      const int stride = img.width();
+      const value_type* data = img.data();
+
+      int x = fixed(x0), y = fixed(y0), fdx = fixed(dx), fdy = fixed(dy);
+      for(int i = 0; i < count; i++, x += fdx, y += fdy) {
+        int cx = clamp(x, maxX), cy = clamp(y, maxY);
+        const value_type* p = data + (cy >> 16) * stride + (cx >> 16);
+        int fx = (cx >> 8) & 0xFF, fy = (cy >> 8) & 0xFF;
+        int top    = p[0]      * (256 - fx) + p[1]          * fx;
+        int bottom = p[stride] * (256 - fx) + p[stride + 1] * fx;
+        out[i] = static_cast<value_type>((top * (256 - fy) + bottom * fy + 0x8000) >> 16);
+      }
+    }
+
+    /**
+     * Samples a line using nearest neighbour interpolation.
+     *
+     * @see bilinear()
+     */
+    static void nearest(const vigra::BImage& img, double x0, double y0, double dx, double dy, int count, value_type* out) {
+      const int maxX = (img.width() - 1) << 16;
+      const int maxY = (img.height() - 1) << 16;
+      const int stride = img.width();
+      const value_type* data = img.data();
+
+      int x = fixed(x0) + 0x8000, y = fixed(y0) + 0x8000, fdx = fixed(dx), fdy = fixed(dy);
+      for(int i = 0; i < count; i++, x += fdx, y += fdy)
+        out[i] = data[(clamp(y, maxY) >> 16) * stride + (clamp(x, maxX) >> 16)];
+    }
+
+  private:
+    static int fixed(double value) {
+      return static_cast<int>(std::floor(value * 65536.0 + 0.5));
+    }
+
+    static int clamp(int value, int maxValue) {
+      return std::min(std::max(value, 0), maxValue);
+    }
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_LINE_SAMPLER_H
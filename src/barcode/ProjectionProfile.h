@@ -0,0 +1,131 @@
+#ifndef BARCODE_PROJECTION_PROFILE_H
+#define BARCODE_PROJECTION_PROFILE_H
+
+#include "config.h"
+#include <cassert>
+#include <cmath>
+#include <algorithm> /* for std::min() and std::max() */
+#include <vector>
+#include <vigra/stdimage.hxx>
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// ProjectionProfile
+// -------------------------------------------------------------------------- //
+  /**
+   * Column-wise prefix sums of an 8-bit image.
+   *
+   * Makes it possible to average a band of parallel, nearly horizontal
+   * lines in time that depends only on image width, not on the number of
+   * lines in the band.
+   *
+   * Image rows are treated as piecewise-constant along the vertical axis,
+   * so an average over a band with fractional borders is exact integral of
+   * the image over that band.
+   */
+  class ProjectionProfile {
+  public:
+    typedef vigra::BImage::value_type value_type;
+
+    ProjectionProfile(): mWidth(0), mHeight(0) {}
+
+    ProjectionProfile(const vigra::BImage& img) {
+      assign(img);
+    }
+
+    /**
+     * Recomputes prefix sums for the given image. Storage is reused if
+     * possible.
+     *
+     * @param img                      Image to compute prefix sums for.
+     */
+    void assign(const vigra::BImage& img) {
+      mWidth = img.width();
+      mHeight = img.height();
+      mSums.resize(mWidth * (mHeight + 1));
+
+      std::fill(mSums.begin(), mSums.begin() + mWidth, 0);
+      for(int y = 0; y < mHeight; y++) {
+        const int* prev = &mSums[y * mWidth];
+        int* next = &mSums[(y + 1) * mWidth];
+        const value_type* row = img[y];
+        for(int x = 0; x < mWidth; x++)
+          next[x] = prev[x] + row[x];
+      }
+    }
+
+    int width() const {
+      return mWidth;
+    }
+
+    int height() const {
+      return mHeight;
+    }
+
+    /**
+     * Averages a band of parallel lines going from the left border of the
+     * image to its right border.
+     *
+     * @param y0                       Y coordinate of the band center at
+     *                                 the left border.
+     * @param y1                       Y coordinate of the band center at
+     *                                 the right border.
+     * @param bandHeight               Vertical extent of the band, in pixels.
+     * @param step                     Horizontal distance between
+     *                                 consecutive samples, in pixels.
+     * @param count                    Number of samples to take.
+     * @param out[out]                 Output buffer, must have room for
+     *                                 count elements.
+     */
+    void band(double y0, double y1, double bandHeight, double step, int count, value_type* out) const {
+      assert(mWidth > 1 && bandHeight > 0);
+
+      double slope = (y1 - y0) / (mWidth - 1);
+      for(int i = 0; i < count; i++) {
+        double x = std::min(i * step, mWidth - 1.0);
+        double center = y0 + slope * x + 0.5; /* Pixel centers are at half-integer positions in integral coordinates. */
+        double lo = clampY(center - bandHeight / 2), hi = clampY(center + bandHeight / 2);
+        if(hi - lo < 1.0) {
+          /* Band got squeezed at the border, use at least a single row. */
+          lo = std::max(0.0, std::min(lo, mHeight - 1.0));
+          hi = lo + 1.0;
+        }
+
+        int ix = std::min(static_cast<int>(x), mWidth - 2);
+        double fx = x - ix;
+        double left = integral(ix, lo, hi), right = integral(ix + 1, lo, hi);
+        out[i] = static_cast<value_type>(((1.0 - fx) * left + fx * right) / (hi - lo) + 0.5);
+      }
+    }
+
+  private:
+    double clampY(double y) const {
+      return std::max(0.0, std::min(y, static_cast<double>(mHeight)));
+    }
+
+    /**
+     * @returns                        Integral of the given column over
+     *                                 the given vertical span.
+     */
+    double integral(int x, double lo, double hi) const {
+      return prefix(x, hi) - prefix(x, lo);
+    }
+
+    /**
+     * @returns                        Integral of the given column from the
+     *                                 top border to the given position.
+     */
+    double prefix(int x, double y) const {
+      int iy = std::min(static_cast<int>(y), mHeight - 1);
+      double fy = y - iy;
+      int lo = mSums[iy * mWidth + x], hi = mSums[(iy + 1) * mWidth + x];
+      return lo + fy * (hi - lo);
+    }
+
+    int mWidth, mHeight;
+    std::vector<int> mSums;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_PROJECTION_PROFILE_H
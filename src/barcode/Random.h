@@ -0,0 +1,53 @@
+#ifndef BARCODE_RANDOM_H
+#define BARCODE_RANDOM_H
+
+#include "config.h"
+#include <boost/cstdint.hpp>
+#include <boost/random/mersenne_twister.hpp>
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// Random
+// -------------------------------------------------------------------------- //
+  /**
+   * Random number generator for a single recognition trial.
+   *
+   * Generator state is derived from the recognition seed and the trial
+   * number only, so the outcome of a trial does not depend on the thread
+   * it was run on, or on the trials that were run before it.
+   */
+  class Random {
+  public:
+    /**
+     * Constructor.
+     *
+     * @param seed                     Recognition seed.
+     * @param stream                   Number of the trial.
+     */
+    Random(unsigned seed, unsigned stream): mGenerator(mix(seed, stream)) {}
+
+    /**
+     * @returns                        Random number in range [lo, hi).
+     */
+    int operator()(int lo, int hi) {
+      return static_cast<int>(lo + static_cast<boost::int64_t>(hi - lo) * mGenerator() / (static_cast<boost::int64_t>(1) << 32));
+    }
+
+  private:
+    /**
+     * Mixes seed and stream number so that generators for consecutive
+     * streams don't start from correlated states.
+     */
+    static boost::uint32_t mix(boost::uint32_t seed, boost::uint32_t stream) {
+      boost::uint32_t result = seed ^ (stream * 0x9E3779B9u);
+      result = (result ^ (result >> 16)) * 0x85EBCA6Bu;
+      result = (result ^ (result >> 13)) * 0xC2B2AE35u;
+      return result ^ (result >> 16);
+    }
+
+    boost::mt19937 mGenerator;
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_RANDOM_H
@@ -0,0 +1,131 @@
+#ifndef BARCODE_SUBPIXEL_EDGES_H
+#define BARCODE_SUBPIXEL_EDGES_H
+
+#include "config.h"
+#include <cassert>
+#include <cmath>     /* for std::abs() and std::floor() */
+#include <vector>
+
+namespace barcode {
+// -------------------------------------------------------------------------- //
+// SubpixelEdges
+// -------------------------------------------------------------------------- //
+  /**
+   * Measures bar widths of a grayscale scanline with sub-sample precision.
+   *
+   * Edges are located at the extrema of a smoothed derivative of the
+   * scanline, i.e. at zero-crossings of its second derivative, and refined
+   * with a parabola fitted through the extremum and its two neighbours.
+   *
+   * Consecutive edges of the same polarity, which is what JPEG ringing looks
+   * like, are merged into the strongest of them.
+   */
+  class SubpixelEdges {
+  public:
+    /**
+     * Number of fractional bits in the measured widths.
+     */
+    enum {
+      FRACTION_BITS = 4
+    };
+
+    /**
+     * Single edge of a scanline.
+     */
+    struct Edge {
+      Edge(double position, int strength): position(position), strength(strength) {}
+
+      /** Position of the edge, in samples. */
+      double position;
+
+      /** Absolute value of the derivative at the edge. */
+      int strength;
+    };
+
+    /**
+     * Measures widths of the bars of the given scanline.
+     *
+     * Measurement starts at the first dark-going edge and ends at the last
+     * bright-going edge, so the first and the last segments are black bars.
+     *
+     * @param line                     Grayscale scanline.
+     * @param contrast                 Difference between the typical white
+     *                                 and black values of the scanline.
+     * @param edges                    Scratch buffer for edges.
+     * @param widths[out]              Widths of the segments between the
+     *                                 edges, in fixed point with
+     *                                 FRACTION_BITS fractional bits.
+     */
+    template<class T>
+    static void measure(const std::vector<T>& line, int contrast, std::vector<Edge>& edges, std::vector<int>& widths) {
+      assert(contrast > 0);
+
+      edges.clear();
+      widths.clear();
+
+      /* Derivative of a sharp step of the given contrast is twice the
+       * contrast, so this threshold is half the edge height. Lower values
+       * let noise through on scanlines accumulated from just a few lines. */
+      int threshold = contrast;
+
+      /* Sign of the last edge found, -1 for dark-going edges. */
+      int lastSign = 0;
+      int size = static_cast<int>(line.size());
+      for(int i = 3; i + 3 < size; i++) {
+        int g = derivative(line, i);
+        int m = std::abs(g);
+        int prev = std::abs(derivative(line, i - 1)), next = std::abs(derivative(line, i + 1));
+        if(m < threshold || m < prev || m <= next)
+          continue;
+
+        int sign = g < 0 ? -1 : 1;
+        if(lastSign == 0 && sign > 0)
+          continue; /* Skip everything before the first black bar. */
+
+        Edge edge(i + offset(prev, m, next), m);
+        if(sign == lastSign) {
+          /* Same polarity as the previous edge, keep the stronger one. */
+          if(m > edges.back().strength)
+            edges.back() = edge;
+        } else {
+          edges.push_back(edge);
+          lastSign = sign;
+        }
+      }
+
+      /* Drop the trailing dark-going edge, if any. */
+      if(lastSign < 0)
+        edges.pop_back();
+
+      for(std::size_t i = 1; i < edges.size(); i++)
+        widths.push_back(static_cast<int>(std::floor((edges[i].position - edges[i - 1].position) * (1 << FRACTION_BITS) + 0.5)));
+    }
+
+  private:
+    /**
+     * @returns                        Derivative of the scanline at the given
+     *                                 sample, smoothed over two samples on
+     *                                 each side.
+     */
+    template<class T>
+    static int derivative(const std::vector<T>& line, int i) {
+      return static_cast<int>(line[i + 1]) + line[i + 2] - line[i - 1] - line[i - 2];
+    }
+
+    /**
+     * @returns                        Offset of the vertex of a parabola
+     *                                 fitted through three equally spaced
+     *                                 points from the middle one, in range
+     *                                 [-0.5, 0.5].
+     */
+    static double offset(int prev, int curr, int next) {
+      int denominator = prev - 2 * curr + next;
+      if(denominator == 0)
+        return 0.0;
+      return 0.5 * (prev - next) / denominator;
+    }
+  };
+
+} // namespace barcode
+
+#endif // BARCODE_SUBPIXEL_EDGES_H
@@ -25,6 +25,101 @@
  */
 #define MAX_MATCHES 50
 
+/**
+ * Number of trees in a keypoint index.
+ */
+#define KEYPOINT_INDEX_TREES 4
+
+/**
+ * Maximal number of keypoints in a leaf of a keypoint index tree.
+ */
+#define KEYPOINT_INDEX_LEAF_SIZE 8
+
+/**
+ * Number of largest variance dimensions that keypoint index trees pick a
+ * split dimension from.
+ */
+#define KEYPOINT_INDEX_SPLIT_CANDIDATES 5
+
+/**
+ * Maximal number of template descriptors compared with a single image
+ * descriptor during keypoint index search.
+ */
+#define KEYPOINT_INDEX_CHECKS 64
+
+/**
+ * Maximal ratio of distances to the nearest and the second nearest template
+ * descriptors for a keypoint match to be accepted.
+ */
+#define MAX_MATCH_DISTANCE_RATIO 0.8
+
+/**
+ * Number of RANSAC iterations for similarity estimation from indexed
+ * keypoint matches.
+ */
+#define SIMILARITY_RANSAC_ITERATIONS 500
+
+/**
+ * Number of levels of progressive matching. Each level doubles the size of
+ * the image to extract keypoints from and the number of RANSAC iterations
+ * of the previous one, the last level uses the maximal size.
+ */
+#define PROGRESSIVE_MATCH_LEVELS 2
+
+/**
+ * Minimal number of inliers for a progressive matching level to be accepted
+ * without escalating to the next level.
+ */
+#define PROGRESSIVE_MATCH_MIN_INLIERS 24
+
+/**
+ * Maximal root mean square reprojection error of the inliers for a
+ * progressive matching level to be accepted, relative to the maximal RANSAC
+ * error.
+ */
+#define PROGRESSIVE_MATCH_MAX_ERROR 0.5
+
+/**
+ * Size of a template patch for scan tracking, in template pixels.
+ */
+#define TRACKER_PATCH_SIZE 24
+
+/**
+ * Maximal shift of a template patch from its predicted position for scan
+ * tracking, in template pixels.
+ */
+#define TRACKER_SEARCH_RADIUS 12
+
+/**
+ * Number of grid cells that template patches for scan tracking are picked
+ * from, one patch per cell.
+ */
+#define TRACKER_PATCH_COLUMNS 4
+#define TRACKER_PATCH_ROWS 2
+
+/**
+ * Minimal standard deviation of template patch pixels for scan tracking.
+ */
+#define TRACKER_MIN_PATCH_DEVIATION 20
+
+/**
+ * Minimal normalized cross-correlation for a template patch to be found
+ * in a scan.
+ */
+#define TRACKER_MIN_CORRELATION 0.7
+
+/**
+ * Minimal number of template patches found in a scan for the tracked
+ * transformation to be accepted.
+ */
+#define TRACKER_MIN_PATCHES 4
+
+/**
+ * Maximal reprojection error of a found template patch for the tracked
+ * transformation to be accepted, in scan image pixels.
+ */
+#define TRACKER_MAX_ERROR 1.5
+
 /**
  * Initial smoothness of an input image in terms of standard deviation of gaussian filter.
  */
@@ -42,6 +137,52 @@
 #define DEFAULT_MIN_ITERATIONS 16
 #define DEFAULT_MAX_ITERATIONS 512
 
+/**
+ * Default number of threads for barcode recognition. Zero stands for the
+ * number of hardware threads.
+ */
+#define DEFAULT_RECOGNITION_THREADS 1
+
+/**
+ * Default seed for barcode recognition.
+ */
+#define DEFAULT_RECOGNITION_SEED 0
+
+/**
+ * Default vote margin for early stopping of barcode recognition.
+ */
+#define DEFAULT_STOP_MARGIN 4
+
+/**
+ * Default scanline interpolation method for barcode recognition.
+ */
+#define DEFAULT_SAMPLER barcode::ItfRecognizer::SPLINE_SAMPLER
+
+/**
+ * Default scanline accumulation method for barcode recognition.
+ */
+#define DEFAULT_ACCUMULATOR barcode::ItfRecognizer::LINE_ACCUMULATOR
+
+/**
+ * Default segment width measurement method for barcode recognition.
+ */
+#define DEFAULT_EDGE_DETECTOR barcode::ItfRecognizer::BINARY_EDGE_DETECTOR
+
+/**
+ * Default segment width decoding method for barcode recognition.
+ */
+#define DEFAULT_DECODER barcode::ItfRecognizer::HARD_DECODER
+
+/**
+ * Default number of digits in a barcode. Zero stands for any length.
+ */
+#define DEFAULT_CODE_LENGTH 0
+
+/**
+ * Default trial voting method for barcode recognition.
+ */
+#define DEFAULT_VOTING barcode::ItfRecognizer::CODE_VOTING
+
 /**
  * Barcode recognition toolset version
  */
@@ -1,11 +1,18 @@
 #include "config.h"
 #include <iostream>
+#include <fstream>
 #include <exception>
+#include <algorithm> /* for std::max() */
+#include <vector>
 #include <boost/program_options.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
 #include <vigra/stdimage.hxx>
+#include <QFileInfo>
+#include <QDir>
 #include <arx/Foreach.h>
 #include "barcode/ItfCode.h"
+#include "barcode/ItfRenderer.h"
 #include "ImageUtils.h"
 #include "Common.h"
 
@@ -34,6 +41,36 @@ namespace barcode {
   using ::validate; 
 }
 
+/**
+ * Pads barcode to even length, either with a mod 10 checksum or with a zero.
+ */
+void completeCode(barcode::ItfCode& code, bool checkSum) {
+  if(checkSum) {
+    code.addMod10CheckSum();
+  } else {
+    if(code.size() % 2 == 1)
+      code.addDigit(0);
+  }
+}
+
+/**
+ * Reads barcodes from a stream, one per line. Empty lines are ignored.
+ */
+void readCodes(std::istream& stream, std::vector<barcode::ItfCode>& codes) {
+  std::locale defaultLocale;
+  std::string line;
+  for(int lineNumber = 1; std::getline(stream, line); lineNumber++) {
+    boost::trim(line);
+    if(line.empty())
+      continue;
+
+    foreach(char c, line)
+      if(!isdigit(c, defaultLocale))
+        throw std::logic_error("Non-digit character in code at line " + boost::lexical_cast<std::string>(lineNumber) + ".");
+    codes.push_back(barcode::ItfCode(line));
+  }
+}
+
 int main(int argc, char** argv) {
   using namespace boost::program_options;
   using namespace std;
@@ -42,41 +79,96 @@ int main(int argc, char** argv) {
     options_description desc("Allowed options");
     desc.add_options()
       ("help",                                                  "produce help message")
-      ("code,i",     value<barcode::ItfCode>(),                 "digit code (required)")
-      ("output,o",   value<string>()->default_value("out.bmp"), "output file name")
+      ("code,i",     value<barcode::ItfCode>(),                 "digit code")
+      ("list,f",     value<string>(),                           "file with a list of codes, one per line, \"-\" for standard input")
+      ("output,o",   value<string>()->default_value("out.bmp"), "output file name; for a list of codes without a sheet, "
+                                                                "each barcode is written next to it, named after the code")
+      ("columns,n",  value<int>()->default_value(0),            "tile a list of codes into a single sheet with this many columns")
+      ("gap,g",      value<int>()->default_value(10),           "spacing between barcodes in a sheet, in pixels")
       ("checksum,c", bool_switch(),                             "append mod 10 checksum")
       ("width,w",    value<int>()->default_value(1),            "width of a thin bar, in pixels")
       ("height,h",   value<int>()->default_value(50),           "height of barcode area, in pixels")
       ("space,s",    value<int>()->default_value(5),            "spacing between barcode and label, in pixels")
-      ("lheight,l",  value<int>()->default_value(15),           "height of label, in pixels");
+      ("lheight,l",  value<int>()->default_value(15),           "height of label, in pixels")
+      ("inverted",   bool_switch(),                             "swap thin and thick bars");
 
     variables_map vm;
     store(command_line_parser(argc, argv).options(desc).run(), vm);
     notify(vm);
 
-    if(vm.count("help") > 0 || vm.count("code") == 0) {
+    if(vm.count("help") > 0 || vm.count("code") + vm.count("list") != 1) {
       cout << "gen2of5 - Interleaved 2 of 5 barcode image generator, version " << BRT_VERSION << "." << endl;
       cout << endl;
       cout << "USAGE:" << endl;
-      cout << "  gen2of5 [options]" << endl;
+      cout << "  gen2of5 [options] -i CODE" << endl;
+      cout << "  gen2of5 [options] -f LIST" << endl;
       cout << endl;
       cout << desc << endl;
       return 1;
     }
 
-    barcode::ItfCode bCode = vm["code"].as<barcode::ItfCode>();
-    if(vm["checksum"].as<bool>()) {
-      if(bCode.size() % 2 == 0)
-        bCode.addDigit(0);
-      bCode.addDigit(bCode.mod10CheckSum());
+    barcode::ItfRenderer renderer(vm["width"].as<int>(), vm["height"].as<int>(), vm["space"].as<int>(), vm["lheight"].as<int>(), vm["inverted"].as<bool>());
+    string outputFileName = vm["output"].as<string>();
+
+    if(vm.count("code") > 0) {
+      barcode::ItfCode bCode = vm["code"].as<barcode::ItfCode>();
+      completeCode(bCode, vm["checksum"].as<bool>());
+
+      vigra::BImage img;
+      renderer.render(bCode, img);
+      exportImage(img, outputFileName);
+      return 0;
+    }
+
+    vector<barcode::ItfCode> codes;
+    string listFileName = vm["list"].as<string>();
+    if(listFileName == "-") {
+      readCodes(cin, codes);
     } else {
-      if(bCode.size() % 2 == 1)
-        bCode.addDigit(0);
+      ifstream list(listFileName.c_str());
+      if(!list)
+        throw logic_error("Could not open code list \"" + listFileName + "\".");
+      readCodes(list, codes);
     }
+    if(codes.empty())
+      throw logic_error("Code list is empty.");
+    foreach(barcode::ItfCode& code, codes)
+      completeCode(code, vm["checksum"].as<bool>());
 
-    vigra::BImage img;
-    bCode.createImage(img, vm["width"].as<int>(), vm["height"].as<int>(), vm["space"].as<int>(), vm["lheight"].as<int>());
-    exportImage(img, vm["output"].as<string>());
+    int columns = vm["columns"].as<int>();
+    if(columns <= 0) {
+      /* One image per code, with the extension of the output file. */
+      QFileInfo outputInfo(QString::fromLocal8Bit(outputFileName.c_str()));
+      QString suffix = outputInfo.suffix().isEmpty() ? QString() : "." + outputInfo.suffix();
+      vigra::BImage img;
+      foreach(const barcode::ItfCode& code, codes) {
+        renderer.render(code, img);
+        exportImage(img, outputInfo.dir().filePath(QString::fromLatin1(code.string().c_str()) + suffix).toLocal8Bit().constData());
+      }
+      return 0;
+    }
+
+    /* All cells of a sheet have the size of the largest barcode. */
+    int gap = max(vm["gap"].as<int>(), 0);
+    vigra::Size2D cellSize(0, 0);
+    foreach(const barcode::ItfCode& code, codes) {
+      vigra::Size2D size = renderer.size(code);
+      cellSize = vigra::Size2D(max(cellSize.width(), size.width()), max(cellSize.height(), size.height()));
+    }
+
+    int rows = (static_cast<int>(codes.size()) + columns - 1) / columns;
+    columns = min(columns, static_cast<int>(codes.size()));
+    vigra::BImage sheet(columns * cellSize.width() + (columns + 1) * gap, rows * cellSize.height() + (rows + 1) * gap);
+    sheet.init(255);
+    for(int i = 0; i < static_cast<int>(codes.size()); i++) {
+      vigra::Size2D size = renderer.size(codes[i]);
+      vigra::Point2D origin(
+        gap + (i % columns) * (cellSize.width() + gap) + (cellSize.width() - size.width()) / 2,
+        gap + (i / columns) * (cellSize.height() + gap)
+      );
+      renderer.render(codes[i], sheet, origin);
+    }
+    exportImage(sheet, outputFileName);
   } catch(exception& e) {
     cerr << "error: " << e.what() << endl;
     return 1;
@@ -0,0 +1,383 @@
+#include "config.h"
+#include <iostream>
+#include <iomanip>
+#include <exception>
+#include <algorithm> /* for std::sort(), std::min() and std::max() */
+#include <cmath>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <vigra/stdimage.hxx>
+#include <vigra/convolution.hxx>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QImage>
+#include <arx/Foreach.h>
+#include <arx/Utility.h> /* for unreachable() */
+#include "barcode/ItfCode.h"
+#include "barcode/ItfRecognizer.h"
+#include "barcode/ItfRecognizerContext.h"
+#include "barcode/ItfRenderer.h"
+#include "Common.h"
+
+namespace {
+  /**
+   * Degradation applied to generated barcode images.
+   */
+  enum Degradation {
+    NO_DEGRADATION,          /**< Clean image. */
+    BLUR_DEGRADATION,        /**< Gaussian blur, level is sigma in pixels. */
+    NOISE_DEGRADATION,       /**< Additive gaussian noise, level is sigma in gray levels. */
+    JPEG_DEGRADATION,        /**< JPEG compression, level is quality. */
+    ROTATION_DEGRADATION,    /**< Rotation, level is angle in degrees. */
+    PERSPECTIVE_DEGRADATION, /**< Perspective tilt, level is the relative scale difference between the image sides. */
+    BLEED_DEGRADATION,       /**< Ink bleed, level is the number of pixels black bars grow by. */
+    INVERSION_DEGRADATION,   /**< Narrow and wide bars swapped, see ItfEncoding. */
+    DEGRADATION_COUNT
+  };
+
+  const char* const degradationNames[DEGRADATION_COUNT] = {
+    "none", "blur", "noise", "jpeg", "rotation", "perspective", "bleed", "inversion"
+  };
+
+  /**
+   * Single degradation level of the benchmark.
+   */
+  struct Level {
+    Level(Degradation degradation, double amount): degradation(degradation), amount(amount) {}
+
+    Degradation degradation;
+    double amount;
+  };
+
+  /**
+   * Recognition statistics for a single degradation level.
+   */
+  struct Stats {
+    Stats(): correct(0), wrong(0), failed(0), milliseconds(0) {}
+
+    int correct;
+    int wrong;
+    int failed;
+    qint64 milliseconds;
+    std::vector<int> trials;
+  };
+
+  typedef boost::mt19937 Generator;
+
+  /**
+   * Appends benchmark levels for the given degradation.
+   */
+  void addLevels(Degradation degradation, std::vector<Level>& levels) {
+    static const double blur[] = {0.5, 1.0, 1.5, 2.0};
+    static const double noise[] = {10, 20, 40, 60};
+    static const double jpeg[] = {75, 50, 25, 10};
+    static const double rotation[] = {1, 2, 5, 10};
+    static const double perspective[] = {0.1, 0.2, 0.3, 0.4};
+    static const double bleed[] = {1, 2};
+
+    switch(degradation) {
+    case NO_DEGRADATION:          levels.push_back(Level(degradation, 0)); break;
+    case BLUR_DEGRADATION:        foreach(double amount, blur)        levels.push_back(Level(degradation, amount)); break;
+    case NOISE_DEGRADATION:       foreach(double amount, noise)       levels.push_back(Level(degradation, amount)); break;
+    case JPEG_DEGRADATION:        foreach(double amount, jpeg)        levels.push_back(Level(degradation, amount)); break;
+    case ROTATION_DEGRADATION:    foreach(double amount, rotation)    levels.push_back(Level(degradation, amount)); break;
+    case PERSPECTIVE_DEGRADATION: foreach(double amount, perspective) levels.push_back(Level(degradation, amount)); break;
+    case BLEED_DEGRADATION:       foreach(double amount, bleed)       levels.push_back(Level(degradation, amount)); break;
+    case INVERSION_DEGRADATION:   levels.push_back(Level(degradation, 0)); break;
+    default:
+      unreachable();
+    }
+  }
+
+  /**
+   * @returns                          Bilinearly interpolated value of the
+   *                                   given image at the given point, white
+   *                                   outside the image.
+   */
+  int sample(const vigra::BImage& img, double x, double y) {
+    int ix = static_cast<int>(std::floor(x)), iy = static_cast<int>(std::floor(y));
+    double fx = x - ix, fy = y - iy;
+    double sum = 0;
+    for(int dy = 0; dy < 2; dy++) {
+      for(int dx = 0; dx < 2; dx++) {
+        int px = ix + dx, py = iy + dy;
+        int value = (px >= 0 && py >= 0 && px < img.width() && py < img.height()) ? img(px, py) : 255;
+        sum += value * (dx ? fx : 1 - fx) * (dy ? fy : 1 - fy);
+      }
+    }
+    return static_cast<int>(sum + 0.5);
+  }
+
+  vigra::UInt8 clamp(double value) {
+    return static_cast<vigra::UInt8>(std::max(0.0, std::min(255.0, std::floor(value + 0.5))));
+  }
+
+  /**
+   * Rotates the given image around its center, enlarging it so that
+   * nothing gets cut off.
+   */
+  void rotate(const vigra::BImage& src, vigra::BImage& dst, double degrees) {
+    double angle = degrees * M_PI / 180, c = std::cos(angle), s = std::sin(angle);
+    int width = static_cast<int>(std::ceil(std::abs(c) * src.width() + std::abs(s) * src.height()));
+    int height = static_cast<int>(std::ceil(std::abs(s) * src.width() + std::abs(c) * src.height()));
+    dst.resize(width, height);
+
+    for(int y = 0; y < height; y++) {
+      for(int x = 0; x < width; x++) {
+        double u = x - 0.5 * width, v = y - 0.5 * height;
+        dst(x, y) = sample(src, c * u + s * v + 0.5 * src.width(), -s * u + c * v + 0.5 * src.height());
+      }
+    }
+  }
+
+  /**
+   * Applies a perspective tilt around both image axes. The tilt is a
+   * homography that maps point p, relative to the image center, to
+   * p / (1 + k p), so the sides of the image end up scaled differently.
+   */
+  void tilt(const vigra::BImage& src, vigra::BImage& dst, double amount) {
+    dst.resize(src.width(), src.height());
+
+    double kx = amount / src.width(), ky = 0.5 * amount / src.height();
+    double cx = 0.5 * src.width(), cy = 0.5 * src.height();
+    for(int y = 0; y < dst.height(); y++) {
+      for(int x = 0; x < dst.width(); x++) {
+        double u = x - cx, v = y - cy, w = 1 - kx * u - ky * v;
+        dst(x, y) = sample(src, u / w + cx, v / w + cy);
+      }
+    }
+  }
+
+  /**
+   * Grows black bars by the given number of pixels, split between the left
+   * and the right sides of a bar.
+   */
+  void bleed(const vigra::BImage& src, vigra::BImage& dst, int growth) {
+    int left = (growth + 1) / 2, right = growth / 2;
+    dst.resize(src.width(), src.height());
+    for(int y = 0; y < src.height(); y++) {
+      for(int x = 0; x < src.width(); x++) {
+        vigra::UInt8 value = src(x, y);
+        for(int i = std::max(0, x - right); i <= std::min(src.width() - 1, x + left); i++)
+          value = std::min(value, src(i, y));
+        dst(x, y) = value;
+      }
+    }
+  }
+
+  /**
+   * Compresses the given image with JPEG and decompresses it back.
+   */
+  void jpeg(const vigra::BImage& src, vigra::BImage& dst, int quality) {
+    QImage image(src.width(), src.height(), QImage::Format_Indexed8);
+    QVector<QRgb> colorTable(256);
+    for(int i = 0; i < 256; i++)
+      colorTable[i] = qRgb(i, i, i);
+    image.setColorTable(colorTable);
+    for(int y = 0; y < src.height(); y++)
+      std::copy(src[y], src[y] + src.width(), image.scanLine(y));
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    if(!image.save(&buffer, "JPG", quality))
+      throw std::logic_error("Could not compress image with JPEG.");
+
+    QImage decoded;
+    if(!decoded.loadFromData(data, "JPG"))
+      throw std::logic_error("Could not decompress JPEG image.");
+
+    dst.resize(decoded.width(), decoded.height());
+    for(int y = 0; y < decoded.height(); y++)
+      for(int x = 0; x < decoded.width(); x++)
+        dst(x, y) = static_cast<vigra::UInt8>(qGray(decoded.pixel(x, y)));
+  }
+
+  /**
+   * Generates a barcode image with the given degradation.
+   */
+  void generate(const barcode::ItfCode& code, int barWidth, int barHeight, const Level& level, Generator& generator, vigra::BImage& img) {
+    vigra::BImage clean;
+    barcode::ItfRenderer(barWidth, barHeight, 0, 0, level.degradation == INVERSION_DEGRADATION).render(code, clean);
+
+    /* Direction of rotation and tilt is random. */
+    double sign = boost::variate_generator<Generator&, boost::uniform_int<> >(generator, boost::uniform_int<>(0, 1))() ? 1.0 : -1.0;
+
+    switch(level.degradation) {
+    case NO_DEGRADATION:
+    case INVERSION_DEGRADATION:
+      img = clean;
+      break;
+    case BLUR_DEGRADATION:
+      img.resize(clean.size());
+      vigra::gaussianSmoothing(srcImageRange(clean), destImage(img), level.amount);
+      break;
+    case NOISE_DEGRADATION: {
+      boost::variate_generator<Generator&, boost::normal_distribution<> > noise(generator, boost::normal_distribution<>(0.0, level.amount));
+      img.resize(clean.size());
+      for(int y = 0; y < img.height(); y++)
+        for(int x = 0; x < img.width(); x++)
+          img(x, y) = clamp(clean(x, y) + noise());
+      break;
+    }
+    case JPEG_DEGRADATION:
+      jpeg(clean, img, static_cast<int>(level.amount));
+      break;
+    case ROTATION_DEGRADATION:
+      rotate(clean, img, sign * level.amount);
+      break;
+    case PERSPECTIVE_DEGRADATION:
+      tilt(clean, img, sign * level.amount);
+      break;
+    case BLEED_DEGRADATION:
+      bleed(clean, img, static_cast<int>(level.amount));
+      break;
+    default:
+      unreachable();
+    }
+  }
+
+  /**
+   * @returns                          Random barcode of the given length, with
+   *                                   a valid checksum as its last digit.
+   */
+  barcode::ItfCode randomCode(int length, Generator& generator) {
+    boost::variate_generator<Generator&, boost::uniform_int<> > digit(generator, boost::uniform_int<>(0, 9));
+
+    barcode::ItfCode code;
+    for(int i = 0; i < length - 1; i++)
+      code.addDigit(digit());
+    code.addDigit(code.mod10CheckSum());
+    return code;
+  }
+
+  /**
+   * @returns                          Value at the given quantile of the
+   *                                   given sorted values.
+   */
+  int quantile(const std::vector<int>& sorted, double q) {
+    if(sorted.empty())
+      return 0;
+    return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(q * sorted.size()))];
+  }
+
+} // namespace
+
+int main(int argc, char** argv) {
+  using namespace boost::program_options;
+  using namespace std;
+
+  try {
+    RecognitionParams params;
+    string degradations;
+    int count, length, barWidth, barHeight;
+    unsigned benchSeed;
+
+    options_description desc("Allowed options");
+    desc.add_options()
+      ("help",                                                                 "Produce help message.")
+      ("degradations,d", value<string>(&degradations)->default_value("all"),   "Comma-separated list of degradations to benchmark, any of none, blur, noise, jpeg, rotation, perspective, bleed and inversion, or all.")
+      ("count,n",        value<int>(&count)->default_value(200),               "Number of barcodes per degradation level.")
+      ("length,l",       value<int>(&length)->default_value(12),               "Number of digits in a barcode, including checksum.")
+      ("width,w",        value<int>(&barWidth)->default_value(3),              "Width of a narrow bar, in pixels.")
+      ("height,h",       value<int>(&barHeight)->default_value(50),            "Height of barcode area, in pixels.")
+      ("bench-seed",     value<unsigned>(&benchSeed)->default_value(0),        "Seed for barcode generation and degradations.");
+    addRecognitionOptions(desc, params);
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(desc).run(), vm);
+    notify(vm);
+
+    if(vm.count("help") > 0) {
+      cout << "itfbench - Interleaved 2 of 5 recognizer benchmark, version " << BRT_VERSION << "." << endl;
+      cout << endl;
+      cout << "USAGE:" << endl;
+      cout << "  itfbench [options]" << endl;
+      cout << endl;
+      cout << desc << endl;
+      return 1;
+    }
+
+    if(count <= 0)
+      throw logic_error("Number of barcodes must be positive.");
+    if(length <= 0 || length % 2 != 0)
+      throw logic_error("Number of digits must be positive and even.");
+    if(barWidth <= 0 || barHeight <= 0)
+      throw logic_error("Bar dimensions must be positive.");
+
+    /* Parse degradation list. */
+    vector<Level> levels;
+    vector<string> names;
+    boost::split(names, degradations, boost::is_any_of(","));
+    foreach(const string& name, names) {
+      bool found = false;
+      for(int i = 0; i < DEGRADATION_COUNT; i++) {
+        if(name == "all" || name == degradationNames[i]) {
+          addLevels(static_cast<Degradation>(i), levels);
+          found = true;
+        }
+      }
+      if(!found)
+        throw logic_error("Unknown degradation: " + name);
+    }
+
+    cout << left << setw(12) << "degradation" << right << setw(7) << "level" << setw(7) << "count" << setw(9) << "correct" << setw(7) << "wrong" << setw(8) << "failed"
+         << setw(10) << "codes/s" << setw(8) << "trials" << setw(8) << "p50" << setw(8) << "p90" << setw(8) << "max" << endl;
+
+    barcode::ItfRecognizerContext context;
+    barcode::ItfResult result;
+    foreach(const Level& level, levels) {
+      /* Generate all images first, so that only recognition is timed. Each
+       * level uses the same codes. */
+      Generator generator(benchSeed);
+      vector<barcode::ItfCode> codes;
+      vector<vigra::BImage> images(count);
+      for(int i = 0; i < count; i++) {
+        codes.push_back(randomCode(length, generator));
+        generate(codes.back(), barWidth, barHeight, level, generator, images[i]);
+      }
+
+      Stats stats;
+      QElapsedTimer timer;
+      timer.start();
+      for(int i = 0; i < count; i++) {
+        barcode::ItfRecognizer recognizer(images[i], params.sampler, context);
+        params.apply(recognizer);
+        recognizer.run(params.minIterations, params.maxIterations, result);
+
+        stats.trials.push_back(result.trials());
+        if(result.code().size() == 0)
+          stats.failed++;
+        else if(result.code().string() == codes[i].string())
+          stats.correct++;
+        else
+          stats.wrong++;
+      }
+      stats.milliseconds = timer.elapsed();
+
+      sort(stats.trials.begin(), stats.trials.end());
+      double mean = 0;
+      foreach(int trials, stats.trials)
+        mean += trials;
+      mean /= count;
+
+      cout << left << setw(12) << degradationNames[level.degradation] << right << setw(7) << level.amount << setw(7) << count << setw(9) << stats.correct << setw(7) << stats.wrong << setw(8) << stats.failed
+           << setw(10) << fixed << setprecision(1) << count * 1000.0 / max<qint64>(1, stats.milliseconds) << setw(8) << mean << setprecision(6) << resetiosflags(ios::fixed)
+           << setw(8) << quantile(stats.trials, 0.5) << setw(8) << quantile(stats.trials, 0.9) << setw(8) << stats.trials.back() << endl;
+    }
+  } catch (exception& e) {
+    cerr << "error: " << e.what() << endl;
+    return 1;
+  } catch(...) {
+    cerr << "error: Exception of unknown type." << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -2,11 +2,15 @@
 #include <cstdlib> /* for srand() */
 #include <ctime>   /* for time() */
 #include <iostream>
+#include <fstream>
 #include <exception>
 #include <boost/lexical_cast.hpp>
 #include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <vigra/stdimage.hxx>
 #include "acv/Extractor.h"
+#include "KeypointTemplate.h"
+#include "KeypointIndex.h"
 #include "Common.h"
 
 int main(int argc, char** argv) {
@@ -25,13 +29,17 @@ int main(int argc, char** argv) {
       ("input,i", value<string>(), "input file name")
       ("size,s",  value<vigra::Size2D>(&maxSize)->default_value(vigra::Size2D(DEFAULT_MAX_SIZE_X, DEFAULT_MAX_SIZE_Y), boost::lexical_cast<string>(DEFAULT_MAX_SIZE_X) + ":" + boost::lexical_cast<string>(DEFAULT_MAX_SIZE_Y)), 
                                    "maximal size of an image for keypoint extraction, in format w:h")
-      ("draw,d",  value<string>(), "draw keypoints and save result into a file with the given name");
+      ("draw,d",  value<string>(), "draw keypoints and save result into a file with the given name")
+      ("convert,c",                "treat input file as a keypoint file in text or binary format and convert it")
+      ("output,o", value<string>(), "write keypoints into a file with the given name instead of standard output")
+      ("binary,b",                 "write keypoints in binary format, requires output file name")
+      ("index,x", value<string>(), "build descriptor index for the keypoints and save it into a file with the given name");
 
     variables_map vm;
     store(command_line_parser(argc, argv).options(desc).run(), vm);
     notify(vm);
 
-    if(vm.count("help") > 0 || vm.count("input") < 1) {
+    if(vm.count("help") > 0 || vm.count("input") < 1 || (vm.count("binary") > 0 && vm.count("output") < 1)) {
       cout << "kpextract - keypoint extractor, version " << BRT_VERSION << "." << endl;
       cout << endl;
       cout << "USAGE:" << endl;
@@ -41,22 +49,49 @@ int main(int argc, char** argv) {
       return 1;
     }
 
-    /* Load input image. */
-    vigra::BRGBImage image;
-    importImage(image, vm["input"].as<string>());
+    boost::scoped_ptr<KeypointTemplate> keys;
+    if(vm.count("convert") > 0) {
+      /* Load keypoint file. */
+      keys.reset(new KeypointTemplate(vm["input"].as<string>()));
+    } else {
+      /* Load input image. */
+      vigra::BRGBImage image;
+      importImage(image, vm["input"].as<string>());
 
-    /* Extract keypoints from input image. */
-    acv::Extract<> extract;
-    extractKeypoints(image, maxSize, extract);
+      /* Extract keypoints from input image. */
+      acv::Extract<> extract;
+      extractKeypoints(image, maxSize, extract);
 
-    /* Draw keypoints if needed. */
-    if(vm.count("draw") > 0) {
-      importImage(image, vm["input"].as<string>());
-      markKeypoints(extract.keypoints(), image, vigra::RGBValue<vigra::UInt8>(0, 0, 255));
-      exportImage(image, vm["draw"].as<string>());
+      /* Draw keypoints if needed. */
+      if(vm.count("draw") > 0) {
+        importImage(image, vm["input"].as<string>());
+        markKeypoints(extract.keypoints(), image, vigra::RGBValue<vigra::UInt8>(0, 0, 255));
+        exportImage(image, vm["draw"].as<string>());
+      }
+
+      keys.reset(new KeypointTemplate(extract.width(), extract.height(), extract.keypoints()));
     }
 
-    cout << extract;
+    /* Output. */
+    if(vm.count("output") > 0) {
+      ofstream f(vm["output"].as<string>().c_str(), vm.count("binary") > 0 ? ios::out | ios::binary : ios::out);
+      if(!f.is_open())
+        throw logic_error("Could not open output file \"" + vm["output"].as<string>() + "\".");
+      if(vm.count("binary") > 0)
+        keys->writeBinary(f);
+      else
+        keys->writeText(f);
+    } else {
+      keys->writeText(cout);
+    }
+
+    /* Build descriptor index if needed. */
+    if(vm.count("index") > 0) {
+      ofstream f(vm["index"].as<string>().c_str(), ios::out | ios::binary);
+      if(!f.is_open())
+        throw logic_error("Could not open index file \"" + vm["index"].as<string>() + "\".");
+      KeypointIndex(*keys).write(f);
+    }
   } catch (exception& e) {
     cerr << "error: " << e.what() << endl;
     return 1;
@@ -19,6 +19,7 @@ int main(int argc, char** argv) {
       ("help",                                                       "produce help message")
       ("input,i",    value<string>(),                                "input file name")
       ("keys,k",     value<string>(),                                "keypoint file name")
+      ("index,x",    value<string>()->default_value(""),             "keypoint index file name, see kpextract; index is built on load if not given")
       ("output,o",   value<string>()->default_value("out.bmp"),      "output file name")
       ("size,s",     value<vigra::Size2D>(&maxSize)->default_value(vigra::Size2D(DEFAULT_MAX_SIZE_X, DEFAULT_MAX_SIZE_Y), boost::lexical_cast<string>(DEFAULT_MAX_SIZE_X) + "+" + boost::lexical_cast<string>(DEFAULT_MAX_SIZE_Y)), 
                                                                      "maximal size of an image for keypoint extraction, in format w:h")
@@ -39,19 +40,20 @@ int main(int argc, char** argv) {
       return 1;
     }
 
-    /* Load keypoint file. */
-    acv::Extract<> extract;
-    loadExtract(extract, vm["keys"].as<string>());
+    /* Load keypoint file and its descriptor index. */
+    const KeypointIndex& index = cachedIndex(vm["keys"].as<string>(), vm["index"].as<string>());
 
-    /* Load input image. */
-    vigra::BRGBImage srcImage, outImage;
-    importImage(srcImage, vm["input"].as<string>());
+    /* Load input image. It is matched and warped right from the decoded
+     * pixels. */
+    QImage srcImage;
+    vigra::BRGBImage outImage;
+    loadImage(srcImage, vm["input"].as<string>());
 
     /* Match. */
-    match(srcImage, maxSize, extract, outImage, maxErrorPercent / 100.0f, !noLma);
+    match(srcImage, maxSize, index, outImage, maxErrorPercent / 100.0f, !noLma);
 
     /* Output. */
-    exportImage(outImage, vm["output"].as<string>());
+    saveImage(outImage, vm["output"].as<string>());
   } catch (exception& e) {
     cerr << "error: " << e.what() << endl;
     return 1;
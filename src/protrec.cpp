@@ -94,9 +94,9 @@ int main(int argc, char** argv) {
     vigra::Size2D maxSize;
     vigra::Rect2D barRect;
     int maxErrorPercent;
-    bool noLma, drawResults, checkSum;
-    string inputFileName, outFileName, keysFileName, patternFileName;
-    int minIterations, maxIterations;
+    bool noLma, drawResults;
+    string inputFileName, outFileName, keysFileName, indexFileName, patternFileName;
+    RecognitionParams params;
 
     options_description desc("Allowed options");
     desc.add_options()
@@ -105,6 +105,7 @@ int main(int argc, char** argv) {
       ("output,o",         value<string>(&outFileName)->default_value("out.bmp"), 
                                                                             "Output file name.")
       ("keys,k",           value<string>(&keysFileName),                    "Keypoint file name.")
+      ("index",            value<string>(&indexFileName),                   "Keypoint index file name, see kpextract. Index is built on load if not given.")
       ("pattern,x",        value<string>(&patternFileName),                 "Pattern file name.")
       ("draw,d",           bool_switch(&drawResults),                       "Draw results in output file")
       ("position,p",       value<vigra::Rect2D>(&barRect)->default_value(vigra::Rect2D(0, 0, 0, 0), "0:0:0:0"), 
@@ -112,12 +113,8 @@ int main(int argc, char** argv) {
       ("size,s",           value<vigra::Size2D>(&maxSize)->default_value(vigra::Size2D(DEFAULT_MAX_SIZE_X, DEFAULT_MAX_SIZE_Y), boost::lexical_cast<string>(DEFAULT_MAX_SIZE_X) + ":" + boost::lexical_cast<string>(DEFAULT_MAX_SIZE_Y)),
                                                                             "Maximal size of an image for keypoint extraction, in format w:h.")
       ("maxerr,m",         value<int>(&maxErrorPercent)->default_value(2),  "Maximal mismatch in reprojected keypoint position relative to image size, in percent.")
-      ("nolevmar,l",       bool_switch(&noLma),                             "Don't use Levenberg-Marquardt algorithm for homography optimization.")
-      ("checksum,c",       bool_switch(&checkSum),                          "Check mod 10 checksum.")
-      ("min-iterations",   value<int>(&minIterations)->default_value(DEFAULT_MIN_ITERATIONS),
-                                                                            "Minimal number of iterations.")
-      ("max-iterations",   value<int>(&maxIterations)->default_value(DEFAULT_MAX_ITERATIONS),               
-                                                                            "Maximal number of iterations.");
+      ("nolevmar,l",       bool_switch(&noLma),                             "Don't use Levenberg-Marquardt algorithm for homography optimization.");
+    addRecognitionOptions(desc, params);
 
     variables_map vm;
     store(command_line_parser(argc, argv).options(desc).run(), vm);
@@ -134,32 +131,37 @@ int main(int argc, char** argv) {
     }
 
     /* Load keypoints. */
-    acv::Extract<> extract;
-    loadExtract(extract, keysFileName);
+    const KeypointIndex& index = cachedIndex(keysFileName, indexFileName);
+    const KeypointTemplate& keys = index.keys();
 
-    fixNegativeSize(&barRect, extract.width(), extract.height());
+    fixNegativeSize(&barRect, keys.width(), keys.height());
 
     /* Check that barcode lies inside the image. */
-    if(!vigra::Rect2D(0, 0, extract.width(), extract.height()).contains(barRect))
+    if(!vigra::Rect2D(0, 0, keys.width(), keys.height()).contains(barRect))
       throw logic_error("Specified barcode position lies outside the image boundaries.");
 
     /* Load images. */
     vigra::BRGBImage patternImage;
-    importImage(patternImage, patternFileName);
-
-    vigra::BImage srcImage;
-    importImage(srcImage, inputFileName);
+    loadImage(patternImage, patternFileName);
 
     /* Check sizes. */
-    if(patternImage.width() != extract.width() || patternImage.height() != extract.height())
+    if(patternImage.width() != keys.width() || patternImage.height() != keys.height())
       throw logic_error("Sizes of pattern image and destination image differ.");
 
-    /* Match. */
-    vigra::BImage newImage(extract.width(), extract.height());
-    match(srcImage, maxSize, extract, newImage, maxErrorPercent / 100.0f, !noLma);
+    /* Match. Grayscale uncompressed input is matched right from the mapped
+     * file. */
+    vigra::BImage newImage(keys.width(), keys.height());
+    MappedImage mappedImage(inputFileName);
+    if(mappedImage.format() == MappedImage::GRAY8) {
+      match(mappedImage, maxSize, index, newImage, maxErrorPercent / 100.0f, !noLma);
+    } else {
+      vigra::BImage srcImage;
+      loadImage(srcImage, inputFileName);
+      match(srcImage, maxSize, index, newImage, maxErrorPercent / 100.0f, !noLma);
+    }
 
     /* Recognize barcode. */
-    barcode::ItfCode code = recognize(newImage, barRect, minIterations, maxIterations, checkSum);
+    barcode::ItfCode code = recognize(newImage, barRect, params).code();
 
     /* Create regions for pattern image. */
     vigra::BasicImage<unsigned> patternLabelImage(patternImage.size(), 0u);
@@ -187,7 +189,7 @@ int main(int argc, char** argv) {
     patternRegions = createRegions(patternImage, patternLabelImage, patternRegionsCount, false);
 
     /* Binarize input image and create regions. */
-    kMeansBinarize(newImage, newImage);
+    hystogramKMeansBinarize(newImage, newImage);
     vigra::BasicImage<unsigned> inputLabelImage(newImage.size(), 0u);
     int inputRegionsCount = 1 + labelImageWithBackground(srcImageRange(newImage), destImage(inputLabelImage), true, vigra::white<vigra::UInt8>());
     vector<shiken::RegionInfo> inputRegions = createRegions(newImage, inputLabelImage, inputRegionsCount, false);
@@ -287,7 +289,7 @@ int main(int argc, char** argv) {
     convert(newImage, tmp);
     foreach(PointMatch& match, pointMatches)
       drawLine(tmp, match.first().x(), match.first().y(), match.second().x(), match.second().y(), vigra::RGBValue<vigra::UInt8>(255, 0, 0));
-    exportImage(tmp, "marked.png");
+    saveImage(tmp, "marked.png");
 #endif
 
     /* Warp. */
@@ -297,7 +299,7 @@ int main(int argc, char** argv) {
 
     /* Write normalized file if not drawing results. */
     if(!drawResults)
-      exportImage(newImage, outFileName);
+      saveImage(newImage, outFileName);
 
     /* Prepare to draw results if needed. */
     vigra::BRGBImage resultImage;
@@ -336,8 +338,8 @@ int main(int argc, char** argv) {
     /* Write fist row. */
     cout << code.string() << ";";
     cout << sqrt(arx::sqr(model(0, 0)) + arx::sqr(model(0, 1))) << ";"; /* Model defines a rotation transformation, so here we have sqr(SCALE * sin(ALPHA)) + sqr(SCALE * cos(ALPHA)) = sqr(SCALE). */
-    cout << extract.width() << ";";
-    cout << extract.height() << ";";
+    cout << keys.width() << ";";
+    cout << keys.height() << ";";
     cout << endl;
 
     /* Examine regions, classify & output results. */
@@ -409,7 +411,7 @@ int main(int argc, char** argv) {
     }
 
     if(drawResults)
-      exportImage(resultImage, outFileName);
+      saveImage(resultImage, outFileName);
 
   } catch (exception& e) {
     cerr << "error: " << e.what() << endl;
@@ -1,61 +1,300 @@
 #include "config.h"
-#include <cstdlib> /* for srand() */
-#include <ctime>   /* for time() */
 #include <iostream>
+#include <fstream>
 #include <exception>
+#include <algorithm> /* for std::min() and std::max() */
+#include <cmath>
+#include <string>
+#include <vector>
 #include <boost/program_options.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <QDir>
+#include <QImageReader>
 #include <arx/ext/Vigra.h>
 #include <arx/ext/Qt.h>
+#include <arx/Foreach.h>
+#include "barcode/ItfRecognizerContext.h"
 #include "Common.h"
 
+namespace {
+  /**
+   * Single input of a batch.
+   */
+  struct BatchItem {
+    BatchItem(const std::string& fileName, const vigra::Rect2D& position): fileName(fileName), position(position) {}
+
+    std::string fileName;
+    vigra::Rect2D position;
+  };
+
+  /**
+   * Parses barcode position in format x:y:w:h.
+   */
+  vigra::Rect2D parsePosition(const std::string& s) {
+    std::vector<std::string> parts;
+    boost::split(parts, s, boost::is_any_of(":"));
+    if(parts.size() != 4)
+      throw std::logic_error("Invalid barcode position \"" + s + "\", expected x:y:w:h.");
+
+    int values[4];
+    for(int i = 0; i < 4; i++) {
+      try {
+        values[i] = boost::lexical_cast<int>(boost::trim_copy(parts[i]));
+      } catch(boost::bad_lexical_cast&) {
+        throw std::logic_error("Invalid barcode position \"" + s + "\", expected x:y:w:h.");
+      }
+    }
+    return vigra::Rect2D(vigra::Point2D(values[0], values[1]), vigra::Size2D(values[2], values[3]));
+  }
+
+  /**
+   * Reads batch items from a manifest. Each line of a manifest contains a
+   * file name, optionally followed by a tab and barcode position in format
+   * x:y:w:h. Empty lines and lines starting with '#' are ignored.
+   */
+  void readManifest(std::istream& stream, std::vector<BatchItem>& items) {
+    std::string line;
+    while(std::getline(stream, line)) {
+      boost::trim_right_if(line, boost::is_any_of("\r"));
+      if(line.empty() || line[0] == '#')
+        continue;
+
+      std::string::size_type tab = line.rfind('\t');
+      if(tab == std::string::npos)
+        items.push_back(BatchItem(line, vigra::Rect2D(0, 0, 0, 0)));
+      else
+        items.push_back(BatchItem(line.substr(0, tab), parsePosition(line.substr(tab + 1))));
+    }
+  }
+
+  /**
+   * Adds all images in the given directory to a batch, in file name order.
+   * Whole images are searched for barcodes.
+   */
+  void readDirectory(const std::string& dirName, std::vector<BatchItem>& items) {
+    QDir dir(QString::fromLocal8Bit(dirName.c_str()));
+    if(!dir.exists())
+      throw std::logic_error("Directory \"" + dirName + "\" does not exist.");
+
+    QStringList filters;
+    foreach(const QByteArray& format, QImageReader::supportedImageFormats())
+      filters.append("*." + QString::fromLatin1(format));
+
+    foreach(const QString& entry, dir.entryList(filters, QDir::Files, QDir::Name))
+      items.push_back(BatchItem(dir.filePath(entry).toLocal8Bit().constData(), vigra::Rect2D(0, 0, 0, 0)));
+  }
+
+
+// -------------------------------------------------------------------------- //
+// BatchRecognizer
+// -------------------------------------------------------------------------- //
+  /**
+   * Recognizes barcodes in a batch of images on a pool of worker threads.
+   *
+   * Each worker keeps its own recognizer context and image buffer, so that
+   * once these have grown to the largest image of the batch, the only
+   * allocations left are those of image loading.
+   *
+   * For each input, a line containing the file name and either the
+   * recognized barcode or an error message, separated by a tab, is written
+   * into the output stream. Lines are written either in input order, or as
+   * soon as recognition of an input finishes.
+   */
+  class BatchRecognizer: public boost::noncopyable {
+  public:
+    /**
+     * Constructor.
+     *
+     * @param items                    Inputs to recognize.
+     * @param params                   Recognition parameters.
+     * @param ordered                  Whether output lines must be written in
+     *                                 input order.
+     * @param stream                   Output stream.
+     */
+    BatchRecognizer(const std::vector<BatchItem>& items, const RecognitionParams& params, bool ordered, std::ostream& stream):
+      mItems(items), mParams(params), mOrdered(ordered), mStream(stream), mLines(items.size()), mDone(items.size(), false), mNext(0), mWritten(0), mFailed(0) {}
+
+    /**
+     * Runs recognition.
+     *
+     * @param threadCount              Number of worker threads, zero for the
+     *                                 number of hardware threads.
+     * @returns                        Number of inputs that could not be
+     *                                 recognized.
+     */
+    int run(int threadCount) {
+      if(threadCount == 0)
+        threadCount = std::max(1u, boost::thread::hardware_concurrency());
+      threadCount = std::min(threadCount, std::max(1, static_cast<int>(mItems.size())));
+
+      boost::thread_group threads;
+      for(int i = 0; i < threadCount; i++)
+        threads.create_thread(boost::bind(&BatchRecognizer::work, this));
+      threads.join_all();
+
+      mStream.flush();
+      return mFailed;
+    }
+
+  private:
+    void work() {
+      barcode::ItfRecognizerContext context;
+      barcode::ItfResult result;
+      vigra::BImage image;
+
+      while(true) {
+        int index;
+        {
+          boost::mutex::scoped_lock lock(mMutex);
+          if(mNext >= static_cast<int>(mItems.size()))
+            return;
+          index = mNext++;
+        }
+
+        const BatchItem& item = mItems[index];
+        std::string line = item.fileName + '\t';
+        bool failed = false;
+        try {
+          vigra::Rect2D barRect = item.position;
+          loadBarcodeImage(image, item.fileName, barRect);
+          recognize(image, barRect, mParams, context, result);
+          line += result.code().string();
+        } catch(std::exception& e) {
+          line += std::string("error: ") + e.what();
+          failed = true;
+        } catch(...) {
+          line += "error: Exception of unknown type.";
+          failed = true;
+        }
+
+        boost::mutex::scoped_lock lock(mMutex);
+        if(failed)
+          mFailed++;
+        if(mOrdered) {
+          mLines[index].swap(line);
+          mDone[index] = true;
+          while(mWritten < static_cast<int>(mItems.size()) && mDone[mWritten]) {
+            mStream << mLines[mWritten] << std::endl;
+            std::string().swap(mLines[mWritten]);
+            mWritten++;
+          }
+        } else {
+          mStream << line << std::endl;
+        }
+      }
+    }
+
+    const std::vector<BatchItem>& mItems;
+    const RecognitionParams& mParams;
+    bool mOrdered;
+    std::ostream& mStream;
+    std::vector<std::string> mLines;
+    std::vector<char> mDone;
+    int mNext;
+    int mWritten;
+    int mFailed;
+    boost::mutex mMutex;
+  };
+
+} // namespace
+
+
 int main(int argc, char** argv) {
   using namespace boost::program_options;
   using namespace std;
 
-  time_t t;
-  srand(static_cast<int>(time(&t)));
-
   try {
     std::string inputFileName;
+    std::string manifestFileName;
+    std::string directoryName;
     vigra::Rect2D barRect;
-    bool checkSum;
-    int minIterations, maxIterations;
+    int jobCount;
+    RecognitionParams params;
 
     options_description desc("Allowed options");
     desc.add_options()
       ("help",                                               "Produce help message.")
       ("input,i",          value<string>(&inputFileName),    "Input file name.")
-      ("position,p",       value<vigra::Rect2D>(&barRect)->default_value(vigra::Rect2D(0, 0, 0, 0), "0:0:0:0"), 
+      ("position,p",       value<vigra::Rect2D>(&barRect)->default_value(vigra::Rect2D(0, 0, 0, 0), "0:0:0:0"),
                                                              "Barcode position in input file, in format x:y:w:h.")
-      ("checksum,c",       bool_switch(&checkSum),           "Check mod 10 checksum.")
-      ("min-iterations",   value<int>(&minIterations)->default_value(DEFAULT_MIN_ITERATIONS),  
-                                                             "Minimal number of iterations.")
-      ("max-iterations",   value<int>(&maxIterations)->default_value(DEFAULT_MAX_ITERATIONS), 
-                                                             "Maximal number of iterations.");
+      ("manifest,m",       value<string>(&manifestFileName), "Batch mode: recognize files listed in a manifest, \"-\" for standard input. Each line contains a file name, optionally followed by a tab and barcode position.")
+      ("directory,d",      value<string>(&directoryName),    "Batch mode: recognize all images in a directory.")
+      ("jobs,j",           value<int>(&jobCount)->default_value(0),
+                                                             "Batch mode: number of images recognized in parallel, 0 for the number of hardware threads.")
+      ("unordered",                                          "Batch mode: write results as soon as they are ready instead of in input order.")
+      ("all,a",                                              "Find and recognize all barcodes in the input file at any angle. Position is ignored.");
+    addRecognitionOptions(desc, params);
 
     variables_map vm;
     store(command_line_parser(argc, argv).options(desc).run(), vm);
     notify(vm);
 
-    if(vm.count("help") > 0 || inputFileName.empty()) {
+    int modeCount = !inputFileName.empty() + !manifestFileName.empty() + !directoryName.empty();
+    if(vm.count("help") > 0 || modeCount != 1) {
       cout << "rec2of5 - Interleaved 2 of 5 barcode recognizer, version " << BRT_VERSION << "." << endl;
       cout << endl;
       cout << "USAGE:" << endl;
-      cout << "  rec2of5 [options]" << endl;
+      cout << "  rec2of5 [options] -i FILE" << endl;
+      cout << "  rec2of5 [options] -m MANIFEST" << endl;
+      cout << "  rec2of5 [options] -d DIRECTORY" << endl;
+      cout << endl;
+      cout << "In batch mode, one line is written for each input: file name and either" << endl;
+      cout << "the barcode or an error message, separated by a tab. Each image is" << endl;
+      cout << "recognized in a single thread unless --threads is given." << endl;
+      cout << endl;
+      cout << "With --all, one line is written for each barcode found: the barcode, x and" << endl;
+      cout << "y of its center, angle of its axis in degrees and confidence, separated by" << endl;
+      cout << "tabs." << endl;
       cout << endl;
       cout << desc << endl;
       return 1;
     }
 
+    if(inputFileName.empty()) {
+      if(vm.count("all") > 0)
+        throw logic_error("Option --all can't be used in batch mode.");
+
+      std::vector<BatchItem> items;
+      if(manifestFileName == "-") {
+        readManifest(cin, items);
+      } else if(!manifestFileName.empty()) {
+        ifstream manifest(manifestFileName.c_str());
+        if(!manifest)
+          throw logic_error("Could not open manifest \"" + manifestFileName + "\".");
+        readManifest(manifest, items);
+      } else {
+        readDirectory(directoryName, items);
+      }
+
+      /* Images are already recognized in parallel. */
+      if(vm["threads"].defaulted())
+        params.threadCount = 1;
+
+      BatchRecognizer recognizer(items, params, vm.count("unordered") == 0, cout);
+      return recognizer.run(jobCount) == 0 ? 0 : 1;
+    }
+
     vigra::BImage image;
-    importImage(image, inputFileName);
+    if(vm.count("all") > 0) {
+      loadImage(image, inputFileName);
 
-    fixNegativeSize(&barRect, image.size());
-    if(!vigra::Rect2D(vigra::Point2D(0, 0), image.size()).contains(barRect))
-      throw logic_error("Specified barcode position lies outside the input image boundaries.");
+      std::vector<barcode::ItfDetection> detections;
+      locateAndRecognizeAll(image, params, detections);
+      foreach(const barcode::ItfDetection& detection, detections) {
+        const barcode::ItfLocation& location = detection.location();
+        cout << detection.code().string() << '\t' << location.x() << '\t' << location.y() << '\t' 
+             << location.angle() * 180.0 / M_PI << '\t' << detection.confidence() << endl;
+      }
+      return detections.empty() ? 1 : 0;
+    }
 
-    barcode::ItfCode code = recognize(image, barRect, minIterations, maxIterations, checkSum);
-    cout << code.string();
+    loadBarcodeImage(image, inputFileName, barRect);
+    barcode::ItfResult result = recognize(image, barRect, params);
+    cout << result.code().string();
   } catch (exception& e) {
     cerr << "error: " << e.what() << endl;
     return 1;
@@ -65,4 +304,4 @@ int main(int argc, char** argv) {
   }
 
   return 0;
-}
\ No newline at end of file
+}
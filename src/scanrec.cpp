@@ -1,6 +1,7 @@
 #include "config.h"
 #include <iostream>
 #include <exception>
+#include <QFile>
 #include <QTextStream>
 #include "Common.h"
 #include "XmlCommons.h"
@@ -16,15 +17,17 @@ int main(int argc, char** argv) {
 
   QDomDocument document = newDocument();
   QDomElement root = appendElement(document, "scanrec-result");
+  std::vector<MatchAttempt> path;
 
   try {
     vigra::Size2D maxSize;
     vigra::Rect2D barRect;
     vigra::Rect2D viewRect;
     int maxErrorPercent;
-    bool noLma, checkSum;
-    string inputFileName, outFileName, keysFileName, viewportFileName;
-    int minIterations, maxIterations;
+    bool noLma;
+    bool luma;
+    string inputFileName, outFileName, keysFileName, indexFileName, viewportFileName;
+    RecognitionParams params;
 
     stage = "Parsing parameters"; 
 
@@ -33,22 +36,20 @@ int main(int argc, char** argv) {
       ("help",                                                              "Produce help message.")
       ("input,i",          value<string>(&inputFileName),                   "Input file name.")
       ("keys,k",           value<string>(&keysFileName),                    "Keypoint file name.")
+      ("index,x",          value<string>(&indexFileName),                   "Keypoint index file name, see kpextract. Index is built on load if not given.")
       ("output,o",         value<string>(&outFileName)->default_value("out.bmp"), 
                                                                             "Output file name.")
       ("size,s",           value<vigra::Size2D>(&maxSize)->default_value(vigra::Size2D(DEFAULT_MAX_SIZE_X, DEFAULT_MAX_SIZE_Y), boost::lexical_cast<string>(DEFAULT_MAX_SIZE_X) + ":" + boost::lexical_cast<string>(DEFAULT_MAX_SIZE_Y)),
                                                                             "Maximal size of an image for keypoint extraction, in format w:h.")
       ("maxerr,m",         value<int>(&maxErrorPercent)->default_value(2),  "Maximal mismatch in reprojected keypoint position relative to image size, in percent.")
       ("nolevmar,l",       bool_switch(&noLma),                             "Don't use Levenberg-Marquardt algorithm for homography optimization.")
+      ("luma,y",           bool_switch(&luma),                              "Align on luminance only. Output image is grayscale, and color is only resampled for the viewport.")
       ("position,p",       value<vigra::Rect2D>(&barRect)->default_value(vigra::Rect2D(0, 0, 0, 0), "0:0:0:0"), 
                                                                             "Barcode position in input file, in format x:y:w:h.")
-      ("checksum,c",       bool_switch(&checkSum),                          "Check mod 10 checksum.")
-      ("min-iterations",   value<int>(&minIterations)->default_value(DEFAULT_MIN_ITERATIONS),
-                                                                            "Minimal number of iterations.")
-      ("max-iterations",   value<int>(&maxIterations)->default_value(DEFAULT_MAX_ITERATIONS),               
-                                                                            "Maximal number of iterations.")
       ("vpfile,f",         value<string>(&viewportFileName),                "Viewport file name.")
       ("viewport,v",       value<vigra::Rect2D>(&viewRect)->default_value(vigra::Rect2D(0, 0, 0, 0), "0:0:0:0"), 
                                                                             "Viewport, in format x:y:w:h.");
+    addRecognitionOptions(desc, params);
 
     variables_map vm;
     store(command_line_parser(argc, argv).options(desc).run(), vm);
@@ -66,44 +67,71 @@ int main(int argc, char** argv) {
 
     /* Load keypoint file. */
     stage = "Loading keypoint file"; 
-    acv::Extract<> extract;
-    loadExtract(extract, keysFileName);
+    const KeypointIndex& index = cachedIndex(keysFileName, indexFileName);
+    const KeypointTemplate& keys = index.keys();
 
-    fixNegativeSize(&barRect, extract.width(), extract.height());
-    fixNegativeSize(&viewRect, extract.width(), extract.height());
+    fixNegativeSize(&barRect, keys.width(), keys.height());
+    fixNegativeSize(&viewRect, keys.width(), keys.height());
 
     /* Check that barcode lies inside the image. */
     stage = "Checking parameters"; 
-    if(!vigra::Rect2D(0, 0, extract.width(), extract.height()).contains(barRect))
+    if(!vigra::Rect2D(0, 0, keys.width(), keys.height()).contains(barRect))
       throw logic_error("Specified barcode position lies outside the image boundaries.");
 
     /* Check that viewport lies inside the image. */
-    if(!vigra::Rect2D(0, 0, extract.width(), extract.height()).contains(viewRect))
+    if(!vigra::Rect2D(0, 0, keys.width(), keys.height()).contains(viewRect))
       throw logic_error("Specified viewport position lies outside the image boundaries.");
 
-    /* Load input image. */
-    stage = "Loading input image"; 
-    vigra::BRGBImage rgbImage, outImage;
-    importImage(rgbImage, inputFileName);
-    if(rgbImage.width() == 0 || rgbImage.height() == 0)
-      throw logic_error("Could not load input image \"" + inputFileName + "\"");
-
-    /* Match. */
-    stage = "Matching"; 
-    RansacModel model = match(rgbImage, maxSize, extract, outImage, maxErrorPercent / 100.0f, !noLma);
-
-    /* Save warped image. */
-    stage = "Saving warped image"; 
-    exportImage(outImage, outFileName);
+    /* Load input image & match. */
+    QImage rgbImage;
+    vigra::BRGBImage outImage;
+    vigra::BImage lumaOutImage;
+    RansacModel model;
+    if(luma) {
+      stage = "Loading input image"; 
+      QFile file(QString::fromLocal8Bit(inputFileName.c_str()));
+      if(!file.open(QIODevice::ReadOnly))
+        throw logic_error("Could not load input image \"" + inputFileName + "\"");
+      QByteArray contents = file.readAll();
+      EncodedImage image(reinterpret_cast<const uchar*>(contents.constData()), contents.size());
+
+      /* Keypoints are extracted from the reduced image, only warping needs 
+       * the full one. */
+      stage = "Matching"; 
+      model = progressiveMatchModel(image.reduced(maxSize), maxSize, index, maxErrorPercent / 100.0f, !noLma, static_cast<float>(image.reduction()), &path);
+
+      stage = "Warping"; 
+      vigra::BImage lumaImage;
+      image.decode(lumaImage);
+      lumaOutImage.resize(keys.width(), keys.height());
+      lumaOutImage.init(vigra::white<vigra::UInt8>());
+      warpImage(lumaImage, lumaOutImage, model);
+
+      /* Save warped image. */
+      stage = "Saving warped image"; 
+      saveImage(lumaOutImage, outFileName);
+    } else {
+      stage = "Loading input image"; 
+      loadImage(rgbImage, inputFileName);
+
+      stage = "Matching"; 
+      model = match(rgbImage, maxSize, index, outImage, maxErrorPercent / 100.0f, !noLma, &path);
+
+      /* Save warped image. */
+      stage = "Saving warped image"; 
+      saveImage(outImage, outFileName);
+    }
 
     /* Recognize barcode. */
     stage = "Recognizing barcode"; 
     try {
-      barcode::ItfCode code = recognize(outImage, barRect, minIterations, maxIterations, checkSum);
+      barcode::ItfResult result = luma ? recognize(lumaOutImage, barRect, params) : recognize(outImage, barRect, params);
       
       /* Output. */
       stage = "Writing result"; 
-      appendElement(root, "code", QString::fromStdString(code.string()));
+      appendElement(root, "code", QString::fromStdString(result.code().string()));
+      appendElement(root, "trials", QString::number(result.trials()));
+      appendElement(root, "margin", QString::number(result.margin()));
     } catch (exception &e) {
       /* Recognition failed. */
       appendElement(root, "error", "1");
@@ -111,8 +139,8 @@ int main(int argc, char** argv) {
     }
 
     /* Output. */
-    appendElement(root, "width", QString::number(extract.width()));
-    appendElement(root, "height", QString::number(extract.height()));
+    appendElement(root, "width", QString::number(keys.width()));
+    appendElement(root, "height", QString::number(keys.height()));
     /* Model defines a rotation transformation, so here we have sqr(SCALE * sin(ALPHA)) + sqr(SCALE * cos(ALPHA)) = sqr(SCALE). */
     appendElement(root, "scale", QString::number(sqrt(arx::sqr(model(0, 0)) + arx::sqr(model(0, 1)))));
 
@@ -120,8 +148,14 @@ int main(int argc, char** argv) {
     stage = "Generating & saving viewport image"; 
     if(!viewportFileName.empty()) {
       vigra::BRGBImage vpImage(viewRect.size());
-      copyImage(srcImageRange(outImage, viewRect), destImage(vpImage));
-      exportImage(vpImage, viewportFileName);
+      if(luma) {
+        /* Color is only needed here, so only the viewport is resampled. */
+        loadImage(rgbImage, inputFileName);
+        warpRegion(srcImageRange(rgb32View(rgbImage), QRgbAccessor()), model, viewRect, vpImage);
+      } else {
+        copyImage(srcImageRange(outImage, viewRect), destImage(vpImage));
+      }
+      saveImage(vpImage, viewportFileName);
     }
   } catch (exception& e) {
     appendElement(root, "error", "2");
@@ -131,6 +165,21 @@ int main(int argc, char** argv) {
     appendElement(root, "error-string", QString::fromStdString("error on stage \"" + stage + "\": Unknown error"));
   }
 
+  /* Matching levels tried, also when matching failed. */
+  if(!path.empty()) {
+    QDomElement pathElement = appendElement(root, "match-path");
+    for(std::size_t i = 0; i < path.size(); i++) {
+      QDomElement attemptElement = appendElement(pathElement, "attempt");
+      appendElement(attemptElement, "width", QString::number(path[i].keyImageSize.width()));
+      appendElement(attemptElement, "height", QString::number(path[i].keyImageSize.height()));
+      appendElement(attemptElement, "iterations", QString::number(path[i].ransacIterations));
+      appendElement(attemptElement, "keypoints", QString::number(path[i].keypoints));
+      appendElement(attemptElement, "inliers", QString::number(path[i].inliers));
+      appendElement(attemptElement, "error", QString::number(path[i].error));
+      appendElement(attemptElement, "accepted", path[i].accepted ? "1" : "0");
+    }
+  }
+
   QTextStream qStdOut(stdout);
   document.save(qStdOut, -1);
 
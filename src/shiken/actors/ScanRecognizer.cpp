@@ -1,9 +1,15 @@
 #include "ScanRecognizer.h"
 #include <cassert>
+#include <cmath>
+#include <algorithm> /* for std::max() */
 #include <exception>
-#include <boost/scoped_array.hpp>
+#include <limits>
 #include <QFile>
+#include <QRectF>
+#include <QFuture>
+#include <QtConcurrentRun>
 #include <QCryptographicHash>
+#include <boost/noncopyable.hpp>
 #include <arx/ext/Vigra.h>
 #include <arx/ext/Qt.h>
 #include <acv/Extractor.h>
@@ -13,26 +19,95 @@
 #include <acv/Lma.h>
 #include <acv/HomographyLmaModeller.h>
 #include <acv/CollageLmaModeller.h>
+#include <barcode/ItfLocator.h>
 #include <barcode/ItfRecognizer.h>
 #include <shiken/Shiken.h>
 #include <shiken/dao/DataAccessDriver.h>
 #include <shiken/dao/SettingsDao.h>
+#include <shiken/utility/BarcodeProcessor.h>
 #include <shiken/utility/Log.h>
 #include <ImageUtils.h>
 #include <Common.h>
 
 namespace shiken {
+  namespace {
+    QString sha1(const char* data, int size) {
+      QCryptographicHash hasher(QCryptographicHash::Sha1);
+      hasher.addData(data, size);
+      return QString(hasher.result().toHex());
+    }
+
+    /**
+     * Waits for a future on destruction, so that the data it reads are not
+     * released while it is running, also when an exception is thrown.
+     */
+    class FutureWaiter: public boost::noncopyable {
+    public:
+      explicit FutureWaiter(const QFuture<QString>& future): mFuture(future) {}
+
+      ~FutureWaiter() {
+        mFuture.waitForFinished();
+      }
+
+    private:
+      QFuture<QString> mFuture;
+    };
+
+    /**
+     * @param roi                      Expected header region, as fractions
+     *                                 of the page size.
+     * @param step                     Expansion step, as a fraction of the
+     *                                 page size.
+     * @param attempt                  Number of failed attempts so far.
+     * @param size                     Page size.
+     * @returns                        Band of the page to search for the
+     *                                 header keypoints on the given attempt.
+     */
+    vigra::Rect2D searchBand(const QRectF& roi, double step, int attempt, const vigra::Size2D& size) {
+      QRectF band = roi.adjusted(-attempt * step, -attempt * step, attempt * step, attempt * step) & QRectF(0, 0, 1, 1);
+      return vigra::Rect2D(
+        static_cast<int>(std::floor(band.left() * size.width())),
+        static_cast<int>(std::floor(band.top() * size.height())),
+        static_cast<int>(std::ceil(band.right() * size.width())),
+        static_cast<int>(std::ceil(band.bottom() * size.height()))
+      );
+    }
+
+    /**
+     * Matches the reduced scan against the form header, searching for it in
+     * a band that is expanded each time matching fails. Each band is matched
+     * coarse to fine, see progressiveMatchModel().
+     */
+    RansacModel matchHeader(const vigra::BImage& keyImage, const vigra::Size2D& maxKeyImageSize, float imageScale, const KeypointIndex& index, double maxRansacError, const QRectF& roi, double bandStep) {
+      for(int attempt = 0; ; attempt++) {
+        vigra::Rect2D band = searchBand(roi, bandStep, attempt, keyImage.size());
+        try {
+          return progressiveMatchModel(keyImage, band, maxKeyImageSize, index, maxRansacError, true, imageScale);
+        } catch(std::logic_error&) {
+          if(band == vigra::Rect2D(vigra::Point2D(0, 0), keyImage.size()))
+            throw;
+          SHIKEN_LOG_MESSAGE("Header not found in search band, expanding");
+        }
+      }
+    }
+
+    barcode::ItfResult recognizeCode(EncodedImage& image, const RansacModel& model, const vigra::Rect2D& codeRect, const RecognitionParams& params) {
+      vigra::BImage codeImage;
+      warpRegion(image, model, codeRect, codeImage);
+
+      barcode::ItfRecognizer recognizer(codeImage, params.sampler);
+      params.apply(recognizer);
+      return recognizer.run(DEFAULT_MIN_ITERATIONS, DEFAULT_MAX_ITERATIONS);
+    }
+  } // namespace
+
   void ScanRecognizer::operator() () {
     SHIKEN_LOG_MESSAGE("Recognition started for file list");
 
-    /* Load keypoint file. */
-    QFile keysFile(":/test_form_header.ky");
-    keysFile.open(QIODevice::ReadOnly);
-    QByteArray rawKeys = keysFile.readAll();
-    std::stringstream keyStream(std::string(rawKeys.constData(), rawKeys.size()));
-    acv::Extract<> extract;
-    keyStream >> extract;
-    assert(extract.keypoints().size() >= MIN_KEYPOINTS_PER_IMAGE);
+    /* Load keypoint file and its descriptor index. They are loaded only
+     * once per process. */
+    const KeypointIndex& index = cachedIndex(":/test_form_header.kyb", ":/test_form_header.kyi");
+    assert(index.keys().size() >= MIN_KEYPOINTS_PER_IMAGE);
 
     SHIKEN_LOG_MESSAGE("Keypoint file loaded");
 
@@ -43,10 +118,35 @@ namespace shiken {
     std::stringstream codePosStream(std::string(rawCodePos.constData(), rawCodePos.size()));
     int codeX, codeY, codeW, codeH;
     codePosStream >> codeX >> codeY >> codeW >> codeH;
-    assert(codeX > 0 && codeW > 0 && codeY > 0 && codeH > 0 && codeX + codeW <= extract.width() && codeY + codeH <= extract.height());
+    assert(codeX > 0 && codeW > 0 && codeY > 0 && codeH > 0 && codeX + codeW <= index.keys().width() && codeY + codeH <= index.keys().height());
 
     SHIKEN_LOG_MESSAGE("Code position read");
 
+    /* Read expected header region. Keypoints are extracted from a band
+     * around it, which is expanded only if matching fails. */
+    QFile roiFile(":/test_form_header_roi.txt");
+    roiFile.open(QIODevice::ReadOnly);
+    QByteArray rawRoi = roiFile.readAll();
+    std::stringstream roiStream(std::string(rawRoi.constData(), rawRoi.size()));
+    double roiX, roiY, roiW, roiH;
+    roiStream >> roiX >> roiY >> roiW >> roiH;
+    assert(roiX >= 0 && roiW > 0 && roiY >= 0 && roiH > 0 && roiX + roiW <= 1 && roiY + roiH <= 1);
+    QRectF roi(roiX, roiY, roiW, roiH);
+    double bandStep = std::max(ctx()->model()->settingsDao()->keySearchBandStep(), 0.01);
+
+    SHIKEN_LOG_MESSAGE("Header region read");
+
+    /* Scans from one sheet feeder batch have almost the same geometry, so
+     * the transformation of the previous scan is verified first. */
+    vigra::BImage headerImage;
+    loadImage(headerImage, ":/test_form_header.png");
+    assert(headerImage.width() == index.keys().width() && headerImage.height() == index.keys().height());
+    ScanTracker tracker(headerImage);
+    RansacModel previousModel;
+    bool hasPreviousModel = false;
+
+    SHIKEN_LOG_MESSAGE("Header image loaded");
+
     /* Loop through all files. */
     foreach(Scan scan, mScans) {
       QString barcode;
@@ -58,42 +158,76 @@ namespace shiken {
         if(!file.open(QIODevice::ReadOnly))
           continue;
 
-        QCryptographicHash hasher(QCryptographicHash::Sha1);
-        boost::scoped_array<char> buffer(new char[1024 * 1024]);
-        while(!file.atEnd()) {
-          qint64 length = file.read(buffer.get(), 1024 * 1024);
-          hasher.addData(buffer.get(), static_cast<int>(length));
+        /* The file is read only once, memory-mapped if possible. It is
+         * hashed on another core while the image is being decoded. */
+        SHIKEN_LOG_MESSAGE("Loading image " << scan.fileName());
+        if(file.size() > std::numeric_limits<int>::max())
+          throw std::logic_error("Could not load image");
+
+        QByteArray contents;
+        const uchar* data = file.map(0, file.size());
+        int size = static_cast<int>(file.size());
+        if(data == NULL) {
+          contents = file.readAll();
+          data = reinterpret_cast<const uchar*>(contents.constData());
+          size = contents.size();
+        }
+        QFuture<QString> hash = QtConcurrent::run(&sha1, reinterpret_cast<const char*>(data), size);
+        FutureWaiter hashWaiter(hash);
+
+        /* Only a reduced image is decoded as a whole, full resolution is
+         * decoded for the barcode region only. */
+        vigra::Size2D maxKeyImageSize(ctx()->model()->settingsDao()->maxKeyImageWidth(), ctx()->model()->settingsDao()->maxKeyImageHeight());
+        EncodedImage image(data, size);
+        bool loaded = true;
+        try {
+          image.reduced(maxKeyImageSize);
+        } catch(std::logic_error&) {
+          loaded = false;
+        }
+        scan.setHash(hash.result());
+        if(!loaded)
+          throw std::logic_error("Could not load image");
+
+        /* Try to read the barcode directly from the scan first, this
+         * doesn't need homography estimation. */
+        RecognitionParams params;
+        params.schema = BarcodeProcessor::schema();
+        barcode::ItfResult result = locateAndRecognize(image, maxKeyImageSize, params);
+        if(result.code().size() == 0) {
+          /* Match & warp, tracking the previous scan if possible. */
+          const vigra::BImage& keyImage = image.reduced(maxKeyImageSize);
+          float imageScale = static_cast<float>(image.reduction());
+          double maxRansacError = ctx()->model()->settingsDao()->maxRansacError();
+          vigra::Rect2D codeRect(codeX, codeY, codeX + codeW, codeY + codeH);
+          RansacModel model;
+          bool tracked = hasPreviousModel && trackModel(tracker, keyImage, imageScale, previousModel, model);
+          if(tracked) {
+            SHIKEN_LOG_MESSAGE("Tracked previous scan, recognizing");
+            result = recognizeCode(image, model, codeRect, params);
+          }
+          if(result.code().size() == 0) {
+            SHIKEN_LOG_MESSAGE("Matching header");
+            model = matchHeader(keyImage, maxKeyImageSize, imageScale, index, maxRansacError, roi, bandStep);
+
+            SHIKEN_LOG_MESSAGE("Recognizing");
+            result = recognizeCode(image, model, codeRect, params);
+          }
+          if(result.code().size() == 0)
+            throw std::logic_error("Could not recognize barcode");
+
+          /* Only a transformation that led to a barcode is tracked on the
+           * next scan. */
+          previousModel = model;
+          hasPreviousModel = true;
+        } else {
+          SHIKEN_LOG_MESSAGE("Barcode located in unwarped image");
         }
-        scan.setHash(QString(hasher.result().toHex()));
 
-        /* Load input fImage. */
-        SHIKEN_LOG_MESSAGE("Loading image " << scan.fileName());
-        vigra::BImage srcImage, outImage;
-        importImage(srcImage, scan.fileName().toStdWString());
-
-        /* Match & warp. */
-        match(
-          srcImage, 
-          vigra::Size2D(ctx()->model()->settingsDao()->maxKeyImageWidth(), ctx()->model()->settingsDao()->maxKeyImageHeight()), 
-          extract, 
-          outImage, 
-          ctx()->model()->settingsDao()->maxRansacError(), 
-          true
-        );
-
-        /* Recognize. */
-        SHIKEN_LOG_MESSAGE("Recognizing");
-        vigra::BImage codeImage(codeW, codeH);
-        copyImage(srcImageRange(outImage, vigra::Rect2D(codeX, codeY, codeX + codeW, codeY + codeH)), destImage(codeImage));
-
-        barcode::ItfCode code = barcode::ItfRecognizer(codeImage)(DEFAULT_MIN_ITERATIONS, DEFAULT_MAX_ITERATIONS);
-        if(code.size() == 0)
-          throw std::logic_error("Could not recognize barcode");
-
-        barcode = QString::fromStdString(code.string());
+        barcode = QString::fromStdString(result.code().string());
 
         scan.setState(Scan::RECOGNIZED);
-        SHIKEN_LOG_MESSAGE("Recognized barcode " << barcode);
+        SHIKEN_LOG_MESSAGE("Recognized barcode " << barcode << " in " << result.trials() << " trials with margin " << result.margin());
       } catch (std::exception& e) {
         (void) e; /* To eliminate "Unused variable" warning when not using logging. */
         SHIKEN_LOG_MESSAGE("Exception " << QString::fromStdString(e.what()));
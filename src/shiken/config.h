@@ -124,6 +124,7 @@
 #define SHIKEN_MAX_KEY_IMAGE_WIDTH_KEY       "max_key_image_width"
 #define SHIKEN_MAX_KEY_IMAGE_HEIGHT_KEY      "max_key_image_height"
 #define SHIKEN_MAX_RANSAC_ERROR_KEY          "max_ransac_error"
+#define SHIKEN_KEY_SEARCH_BAND_STEP_KEY      "key_search_band_step"
 #define SHIKEN_SCANS_UPDATE_INTERVAL_MSECS_KEY "scans_update_interval_msecs"
 
 
@@ -167,6 +168,12 @@
  */
 #define SHIKEN_DEFAULT_MAX_RANSAC_ERROR 0.02
 
+/**
+ * Default step, as a fraction of the page size, by which the band searched
+ * for the form header keypoints is expanded each time matching fails.
+ */
+#define SHIKEN_DEFAULT_KEY_SEARCH_BAND_STEP 0.4
+
 /**
  * Default interval in milliseconds between consecutive requests for a list 
  * of scans that were uploaded to the server.
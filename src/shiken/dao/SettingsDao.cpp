@@ -143,6 +143,7 @@ namespace shiken {
     mMaxKeyImageWidth   = value(SHIKEN_MAX_KEY_IMAGE_WIDTH_KEY,   QString::number(SHIKEN_DEFAULT_MAX_KEY_IMAGE_WIDTH)).toInt();
     mMaxKeyImageHeight  = value(SHIKEN_MAX_KEY_IMAGE_HEIGHT_KEY,  QString::number(SHIKEN_DEFAULT_MAX_KEY_IMAGE_HEIGHT)).toInt();
     mMaxRansacError     = value(SHIKEN_MAX_RANSAC_ERROR_KEY,      QString::number(SHIKEN_DEFAULT_MAX_RANSAC_ERROR)).toDouble();
+    mKeySearchBandStep  = value(SHIKEN_KEY_SEARCH_BAND_STEP_KEY,  QString::number(SHIKEN_DEFAULT_KEY_SEARCH_BAND_STEP)).toDouble();
     mScansUpdateIntervalMsecs = value(SHIKEN_SCANS_UPDATE_INTERVAL_MSECS_KEY, QString::number(SHIKEN_DEFAULT_SCANS_UPDATE_INTERVAL_MSECS)).toInt();
     mUserProxyDesc      = 
       ProxyDescription(
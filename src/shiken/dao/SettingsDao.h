@@ -261,6 +261,18 @@ namespace shiken {
       return mMaxRansacError;
     }
 
+    /**
+     * @returns                        Step, as a fraction of the page size,
+     *                                 by which the band searched for the
+     *                                 form header is expanded each time
+     *                                 matching fails.
+     */
+    double keySearchBandStep() const {
+      QReadLocker locker(&mLock);
+
+      return mKeySearchBandStep;
+    }
+
     /**
      * @returns                        Interval in msecs between requests for
      *                                 scans on server. 
@@ -327,7 +339,7 @@ namespace shiken {
 
     QString mTargetUrl, mHelpUrl, mBinaryUrl, mLogin, mPassword, mDbVersion;
     int mQuizId, mPageCount, mMaxKeyImageWidth, mMaxKeyImageHeight, mScansUpdateIntervalMsecs;
-    double mMaxRansacError;
+    double mMaxRansacError, mKeySearchBandStep;
     ProxyDescription mUserProxyDesc, mProxyDesc;
     QHash<ProxyDescription, ProxyInfo> mProxyInfo;
     bool mSingleUser;
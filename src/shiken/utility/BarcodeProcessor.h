@@ -6,6 +6,7 @@
 #include <boost/preprocessor/stringize.hpp>
 #include <QString>
 #include <QDateTime>
+#include <barcode/ItfSchema.h>
 
 namespace shiken {
 // -------------------------------------------------------------------------- //
@@ -49,6 +50,48 @@ namespace shiken {
       return result;
     }
 
+    /**
+     * @returns                        Structure of printed barcodes, i.e. of
+     *                                 composed barcodes with mod 10 checksum
+     *                                 added by barcode::ItfCode.
+     */
+    static barcode::ItfSchema schema() {
+      barcode::ItfSchema result;
+
+      /* Id. */
+      result.setPrefix(BOOST_PP_STRINGIZE(SHIKEN_TEST_BARCODE_ID));
+
+      /* Compressed guid can contain any digits. Date & time fields are 
+       * derived from the format, runs of the same letter form a field. */
+      const char* format = SHIKEN_BARCODE_DATE_TIME_FORMAT;
+      int start = 22;
+      for(int i = 0; format[i] != '\0'; ) {
+        int size = 1;
+        while(format[i + size] == format[i])
+          size++;
+
+        switch(format[i]) {
+        case 'M': result.addField(start + i, size, 1, 12); break;
+        case 'd': result.addField(start + i, size, 1, 31); break;
+        case 'h': result.addField(start + i, size, 0, 23); break;
+        case 'm':
+        case 's': result.addField(start + i, size, 0, 59); break;
+        default: break; /* Years and milliseconds can be anything. */
+        }
+        i += size;
+      }
+
+      /* Check digit, preceded by a zero if the composed barcode has even 
+       * length. */
+      int length = start + SHIKEN_BARCODE_DATE_TIME_FORMAT_LENGTH;
+      if(length % 2 == 0)
+        result.allowDigits(length++, "0");
+      result.setLength(length + 1);
+      result.setCheckSum(true);
+
+      return result;
+    }
+
   };
 
 } // namespace shiken